@@ -0,0 +1,577 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "heap.h"
+#include "dheap.h"
+#include "pqueue.h"
+#include "twheel.h"
+
+/* Times the priority queues in this tree on the operations the game  *
+ * does: plain insert, remove_min and decrease_key, the turn queue's   *
+ * pop-reschedule-push cycle from game_loop(), and road building's     *
+ * grid Dijkstra from dijkstra_path().  A trace file can be replayed   *
+ * as well; see read_trace().  Reports ns/op and allocations/op, where *
+ * allocations are counted by wrapping malloc() below.  Built with the *
+ * same flags as the game; add -O2 to CFLAGS and CXXFLAGS to compare   *
+ * optimized code.                                                     *
+ *                                                                     *
+ * Usage: bench_heap [-n items] [-r rounds] [-s seed] [trace file]     */
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t nmemb, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void __libc_free(void *ptr);
+}
+
+static uint64_t num_allocs;
+
+/* Every allocation, C or C++, goes through here */
+void *malloc(size_t size)
+{
+  num_allocs++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  num_allocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  num_allocs++;
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+typedef struct bench_item {
+  int32_t key;
+  uint32_t id;
+  heap_node_t *hn;
+  dheap_node_t *dn;
+  uint32_t qpos;
+  struct bench_item *next;
+} bench_item_t;
+
+static int32_t item_cmp(const void *key, const void *with)
+{
+  return ((bench_item_t *) key)->key - ((bench_item_t *) with)->key;
+}
+
+struct item_order {
+  bool operator()(const bench_item_t *a, const bench_item_t *b) const
+  {
+    return a->key < b->key;
+  }
+};
+
+struct item_qpos {
+  uint32_t *operator()(bench_item_t *i) const { return &i->qpos; }
+};
+
+struct item_key {
+  int32_t operator()(const bench_item_t *i) const { return i->key; }
+};
+
+struct item_link {
+  bench_item_t **operator()(bench_item_t *i) const { return &i->next; }
+};
+
+/* One adapter per queue, so the workloads are written once.  Each is *
+ * constructed and destroyed inside the timed region, so the cost of  *
+ * growing the queue counts against it.                               */
+class fib_queue {
+ public:
+  static const char *name() { return "heap (Fibonacci)"; }
+  fib_queue() { heap_init(&h, item_cmp, NULL); }
+  ~fib_queue() { heap_delete(&h); }
+  bool empty() { return !h.size; }
+  void push(bench_item_t *i) { i->hn = heap_insert(&h, i); }
+  bench_item_t *pop()
+  {
+    bench_item_t *i = (bench_item_t *) heap_remove_min(&h);
+    i->hn = NULL;
+    return i;
+  }
+  bool queued(bench_item_t *i) { return i->hn; }
+  void decrease_key(bench_item_t *i)
+  {
+    heap_decrease_key_no_replace(&h, i->hn);
+  }
+ private:
+  heap_t h;
+};
+
+class dheap_queue {
+ public:
+  static const char *name() { return "dheap (4-ary, C)"; }
+  dheap_queue() { dheap_init(&h, item_cmp, NULL); }
+  ~dheap_queue() { dheap_delete(&h); }
+  bool empty() { return !h.size; }
+  void push(bench_item_t *i) { i->dn = dheap_insert(&h, i); }
+  bench_item_t *pop()
+  {
+    bench_item_t *i = (bench_item_t *) dheap_remove_min(&h);
+    i->dn = NULL;
+    return i;
+  }
+  bool queued(bench_item_t *i) { return i->dn; }
+  void decrease_key(bench_item_t *i)
+  {
+    dheap_decrease_key_no_replace(&h, i->dn);
+  }
+ private:
+  dheap_t h;
+};
+
+class template_queue {
+ public:
+  static const char *name() { return "pqueue (4-ary, C++)"; }
+  bool empty() { return q.empty(); }
+  void push(bench_item_t *i) { q.push(i); }
+  bench_item_t *pop() { return q.pop(); }
+  bool queued(bench_item_t *i) { return i->qpos != PQUEUE_NOT_QUEUED; }
+  void decrease_key(bench_item_t *i) { q.decrease_key(i); }
+ private:
+  pqueue<bench_item_t *, item_order, item_qpos> q;
+};
+
+/* Only for the turns workload; a timing wheel has no decrease_key */
+class wheel_queue {
+ public:
+  static const char *name() { return "twheel (timing wheel)"; }
+  bool empty() { return q.empty(); }
+  void push(bench_item_t *i) { q.push(i); }
+  bench_item_t *pop() { return q.pop(); }
+ private:
+  twheel<bench_item_t *, item_key, item_link> q;
+};
+
+typedef enum trace_op {
+  trace_push,
+  trace_pop,
+  trace_decrease
+} trace_op_t;
+
+typedef struct trace_entry {
+  trace_op_t op;
+  uint32_t id;
+  int32_t key;
+} trace_entry_t;
+
+typedef struct bench {
+  uint32_t n;
+  uint32_t rounds;
+  uint32_t seed;
+  bench_item_t *item;
+  int32_t *key;
+  trace_entry_t *trace;
+  uint32_t trace_len;
+  uint32_t trace_items;
+} bench_t;
+
+typedef struct bench_result {
+  uint64_t ns;
+  uint64_t ops;
+  uint64_t allocs;
+  int64_t check;
+} bench_result_t;
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void reset_items(bench_t *b, uint32_t n)
+{
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    b->item[i].key = b->key[i];
+    b->item[i].id = i;
+    b->item[i].hn = NULL;
+    b->item[i].dn = NULL;
+    b->item[i].qpos = PQUEUE_NOT_QUEUED;
+  }
+}
+
+/* The workloads.  Each does its untimed setup, then reports only the *
+ * operation it's named for.  The check value depends on the order    *
+ * things come out, so all queues must agree on it.                   */
+
+template <class Q>
+static void bench_insert(bench_t *b, bench_result_t *r)
+{
+  uint64_t start, allocs;
+  uint32_t i;
+
+  reset_items(b, b->n);
+  start = now_ns();
+  allocs = num_allocs;
+  {
+    Q q;
+
+    for (i = 0; i < b->n; i++) {
+      q.push(b->item + i);
+    }
+    r->ns += now_ns() - start;
+    r->allocs += num_allocs - allocs;
+    r->ops += b->n;
+    r->check += q.pop()->key;
+  }
+}
+
+template <class Q>
+static void bench_remove_min(bench_t *b, bench_result_t *r)
+{
+  uint64_t start, allocs;
+  uint32_t i;
+  Q q;
+
+  reset_items(b, b->n);
+  for (i = 0; i < b->n; i++) {
+    q.push(b->item + i);
+  }
+  start = now_ns();
+  allocs = num_allocs;
+  for (i = 0; i < b->n; i++) {
+    r->check += (int64_t) i * q.pop()->key;
+  }
+  r->ns += now_ns() - start;
+  r->allocs += num_allocs - allocs;
+  r->ops += b->n;
+}
+
+template <class Q>
+static void bench_decrease_key(bench_t *b, bench_result_t *r)
+{
+  uint64_t start, allocs;
+  uint32_t i, j, s;
+  Q q;
+
+  reset_items(b, b->n);
+  for (i = 0; i < b->n; i++) {
+    q.push(b->item + i);
+  }
+  /* A Fibonacci heap is only trees after a consolidation */
+  q.push(q.pop());
+  s = b->seed;
+  start = now_ns();
+  allocs = num_allocs;
+  for (i = 0; i < b->n; i++) {
+    j = rand_r(&s) % b->n;
+    b->item[j].key -= rand_r(&s) % 100;
+    q.decrease_key(b->item + j);
+  }
+  r->ns += now_ns() - start;
+  r->allocs += num_allocs - allocs;
+  r->ops += b->n;
+  for (i = 0; i < b->n; i++) {
+    r->check += (int64_t) i * q.pop()->key;
+  }
+}
+
+/* game_loop(): take the next character, move it, charge it the cost *
+ * of the cell it moved to, and put it back.  Costs are a mix of     *
+ * path, grass and the occasional forest.                            */
+template <class Q>
+static void bench_turns(bench_t *b, bench_result_t *r)
+{
+  static const int32_t cost[8] = { 10, 10, 10, 10, 10, 15, 15, 20 };
+  uint64_t start, allocs;
+  uint32_t i, s;
+  bench_item_t *c;
+
+  reset_items(b, b->n);
+  s = b->seed;
+  start = now_ns();
+  allocs = num_allocs;
+  {
+    Q q;
+
+    for (i = 0; i < b->n; i++) {
+      b->item[i].key = 0;
+      q.push(b->item + i);
+    }
+    for (i = 0; i < b->n * 16; i++) {
+      c = q.pop();
+      r->check += (int64_t) i * c->key;
+      c->key += cost[rand_r(&s) % 8];
+      q.push(c);
+    }
+    r->ns += now_ns() - start;
+    r->allocs += num_allocs - allocs;
+    r->ops += b->n + b->n * 32;
+  }
+}
+
+/* dijkstra_path(): every interior cell of an 80x21 map goes in at     *
+ * once, then cells come out in cost order and lower their neighbors'. *
+ * Heights stand in for the map's height field.                        */
+#define ROAD_X 80
+#define ROAD_Y 21
+
+template <class Q>
+static void bench_roads(bench_t *b, bench_result_t *r)
+{
+  static uint8_t height[ROAD_Y][ROAD_X];
+  static const int32_t dx[4] = { 0, -1, 1, 0 };
+  static const int32_t dy[4] = { -1, 0, 0, 1 };
+  uint64_t start, allocs, ops;
+  uint32_t x, y, k, s;
+  int32_t c;
+  bench_item_t *p, *q;
+
+  assert(b->n >= ROAD_X * ROAD_Y);
+
+  s = b->seed;
+  for (y = 0; y < ROAD_Y; y++) {
+    for (x = 0; x < ROAD_X; x++) {
+      height[y][x] = rand_r(&s) % 256;
+    }
+  }
+  reset_items(b, ROAD_X * ROAD_Y);
+  for (y = 0; y < ROAD_Y; y++) {
+    for (x = 0; x < ROAD_X; x++) {
+      b->item[y * ROAD_X + x].key = INT32_MAX;
+    }
+  }
+  b->item[(ROAD_Y / 2) * ROAD_X + 1].key = 0;
+
+  ops = 0;
+  start = now_ns();
+  allocs = num_allocs;
+  {
+    Q h;
+
+    for (y = 1; y < ROAD_Y - 1; y++) {
+      for (x = 1; x < ROAD_X - 1; x++) {
+        h.push(b->item + y * ROAD_X + x);
+        ops++;
+      }
+    }
+    while (!h.empty()) {
+      p = h.pop();
+      ops++;
+      if (p->key == INT32_MAX) {
+        continue;
+      }
+      r->check += p->key;
+      y = p->id / ROAD_X;
+      x = p->id % ROAD_X;
+      c = p->key + height[y][x];
+      for (k = 0; k < 4; k++) {
+        q = b->item + (y + dy[k]) * ROAD_X + x + dx[k];
+        if (h.queued(q) && q->key > c) {
+          q->key = c;
+          h.decrease_key(q);
+          ops++;
+        }
+      }
+    }
+    r->ns += now_ns() - start;
+    r->allocs += num_allocs - allocs;
+    r->ops += ops;
+  }
+}
+
+template <class Q>
+static void bench_trace(bench_t *b, bench_result_t *r)
+{
+  uint64_t start, allocs;
+  uint32_t i;
+  trace_entry_t *t;
+
+  reset_items(b, b->trace_items);
+  start = now_ns();
+  allocs = num_allocs;
+  {
+    Q q;
+
+    for (i = 0, t = b->trace; i < b->trace_len; i++, t++) {
+      switch (t->op) {
+      case trace_push:
+        b->item[t->id].key = t->key;
+        q.push(b->item + t->id);
+        break;
+      case trace_pop:
+        r->check += (int64_t) i * q.pop()->key;
+        break;
+      case trace_decrease:
+        b->item[t->id].key = t->key;
+        q.decrease_key(b->item + t->id);
+        break;
+      }
+    }
+    r->ns += now_ns() - start;
+    r->allocs += num_allocs - allocs;
+    r->ops += b->trace_len;
+  }
+}
+
+/* A trace is one operation per line:                             *
+ *   i <id> <key>   insert item id with key                        *
+ *   r              remove the minimum                             *
+ *   d <id> <key>   lower queued item id's key to key              *
+ * Ids are small integers naming the items; an item may be inserted *
+ * again after it's been removed.  Anything else is an error.        */
+static int read_trace(bench_t *b, const char *path)
+{
+  FILE *f;
+  char line[80];
+  trace_entry_t t;
+  uint32_t capacity, lineno, depth;
+  unsigned id;
+  int key;
+
+  if (!(f = fopen(path, "r"))) {
+    perror(path);
+    return 1;
+  }
+
+  capacity = 0;
+  lineno = depth = 0;
+  while (fgets(line, sizeof (line), f)) {
+    lineno++;
+    if (line[0] == 'i' && sscanf(line + 1, "%u %d", &id, &key) == 2) {
+      t.op = trace_push;
+      depth++;
+    } else if (line[0] == 'd' && sscanf(line + 1, "%u %d", &id, &key) == 2) {
+      t.op = trace_decrease;
+    } else if (line[0] == 'r') {
+      t.op = trace_pop;
+      id = key = 0;
+      if (!depth--) {
+        fprintf(stderr, "%s:%u: remove from an empty queue\n", path, lineno);
+        fclose(f);
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "%s:%u: bad trace line\n", path, lineno);
+      fclose(f);
+      return 1;
+    }
+    t.id = id;
+    t.key = key;
+    if (b->trace_len == capacity) {
+      capacity = capacity ? capacity * 2 : 1024;
+      b->trace = (trace_entry_t *) realloc(b->trace,
+                                           capacity * sizeof (*b->trace));
+      assert(b->trace);
+    }
+    b->trace[b->trace_len++] = t;
+    if (id >= b->trace_items) {
+      b->trace_items = id + 1;
+    }
+  }
+  fclose(f);
+
+  return 0;
+}
+
+template <class Q>
+static void run_queue(bench_t *b, const char *workload,
+                      void (*f)(bench_t *, bench_result_t *))
+{
+  bench_result_t r;
+  uint32_t i;
+
+  memset(&r, 0, sizeof (r));
+  for (i = 0; i < b->rounds; i++) {
+    f(b, &r);
+  }
+
+  printf("%-14s %-22s %9.1f %9.3f %20lld\n", workload, Q::name(),
+         (double) r.ns / r.ops, (double) r.allocs / r.ops,
+         (long long) r.check);
+}
+
+#define run_workload(b, w)                                       \
+  do {                                                           \
+    run_queue<fib_queue>(b, #w, bench_##w<fib_queue>);           \
+    run_queue<dheap_queue>(b, #w, bench_##w<dheap_queue>);       \
+    run_queue<template_queue>(b, #w, bench_##w<template_queue>); \
+  } while (0)
+
+int main(int argc, char *argv[])
+{
+  bench_t b;
+  uint32_t i, s;
+  int opt;
+
+  memset(&b, 0, sizeof (b));
+  b.n = 10000;
+  b.rounds = 20;
+  b.seed = 327;
+
+  while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+    switch (opt) {
+    case 'n':
+      b.n = atoi(optarg);
+      break;
+    case 'r':
+      b.rounds = atoi(optarg);
+      break;
+    case 's':
+      b.seed = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-n items] [-r rounds] [-s seed] "
+              "[trace file]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc && read_trace(&b, argv[optind])) {
+    return 1;
+  }
+
+  if (b.n < ROAD_X * ROAD_Y) {
+    b.n = ROAD_X * ROAD_Y;
+  }
+  if (b.n < b.trace_items) {
+    b.n = b.trace_items;
+  }
+  if (!b.rounds) {
+    b.rounds = 1;
+  }
+  assert((b.item = (bench_item_t *) calloc(b.n, sizeof (*b.item))));
+  assert((b.key = (int32_t *) calloc(b.n, sizeof (*b.key))));
+  s = b.seed;
+  for (i = 0; i < b.n; i++) {
+    b.key[i] = rand_r(&s) % (b.n * 4);
+  }
+
+  printf("%u items, %u rounds, seed %u\n\n", b.n, b.rounds, b.seed);
+  printf("%-14s %-22s %9s %9s %20s\n",
+         "workload", "queue", "ns/op", "allocs/op", "check");
+  run_workload(&b, insert);
+  run_workload(&b, remove_min);
+  run_workload(&b, decrease_key);
+  run_workload(&b, turns);
+  run_queue<wheel_queue>(&b, "turns", bench_turns<wheel_queue>);
+  run_workload(&b, roads);
+  if (b.trace) {
+    run_workload(&b, trace);
+  }
+
+  free(b.trace);
+  free(b.key);
+  free(b.item);
+
+  return 0;
+}
@@ -25,11 +25,14 @@ const char *char_type_name[num_character_types] = {
   "Trainer",
 };
 
+/* Hikers and rivals step to the free neighbor closest to the PC, and *
+ * fight instead if they're next to it.  Cells they can't enter or get *
+ * to from the PC are INT_MAX in their distance map, and are skipped.  */
 static void move_hiker_func(Character *c, pair_t dest)
 {
   int min;
   int base;
-  int i;
+  int i, d;
 
   base = rand() & 0x7;
 
@@ -38,19 +41,20 @@ static void move_hiker_func(Character *c, pair_t dest)
   min = INT_MAX;
   
   for (i = base; i < 8 + base; i++) {
-    if ((world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                         [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] <=
-         min) &&
+    d = world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]];
+    if (!d) {
+      io_battle(c, &world.pc);
+      dest[dim_x] = c->pos[dim_x];
+      dest[dim_y] = c->pos[dim_y];
+      return;
+    }
+    if (d != INT_MAX && d <= min &&
         !world.cur_map->cmap[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
                             [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]]) {
       dest[dim_x] = c->pos[dim_x] + all_dirs[i & 0x7][dim_x];
       dest[dim_y] = c->pos[dim_y] + all_dirs[i & 0x7][dim_y];
-      min = world.hiker_dist[dest[dim_y]][dest[dim_x]];
-    }
-    if (world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
-      io_battle(c, &world.pc);
-      break;
+      min = d;
     }
   }
 }
@@ -59,7 +63,7 @@ static void move_rival_func(Character *c, pair_t dest)
 {
   int min;
   int base;
-  int i;
+  int i, d;
   
   base = rand() & 0x7;
 
@@ -68,19 +72,20 @@ static void move_rival_func(Character *c, pair_t dest)
   min = INT_MAX;
   
   for (i = base; i < 8 + base; i++) {
-    if ((world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                         [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] <
-         min) &&
+    d = world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
+                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]];
+    if (!d) {
+      io_battle(c, &world.pc);
+      dest[dim_x] = c->pos[dim_x];
+      dest[dim_y] = c->pos[dim_y];
+      return;
+    }
+    if (d != INT_MAX && d < min &&
         !world.cur_map->cmap[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
                             [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]]) {
       dest[dim_x] = c->pos[dim_x] + all_dirs[i & 0x7][dim_x];
       dest[dim_y] = c->pos[dim_y] + all_dirs[i & 0x7][dim_y];
-      min = world.rival_dist[dest[dim_y]][dest[dim_x]];
-    }
-    if (world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
-                        [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
-      io_battle(c, &world.pc);
-      break;
+      min = d;
     }
   }
 }
@@ -100,18 +105,18 @@ static void move_pacer_func(Character *c, pair_t dest)
       return;
   }
 
-  if ((world.cur_map->map[c->pos[dim_y] + n->dir[dim_y]]
-                         [c->pos[dim_x] + n->dir[dim_x]] !=
-       world.cur_map->map[c->pos[dim_y]][c->pos[dim_x]]) ||
+  if ((world.cur_map->terrain(c->pos[dim_x] + n->dir[dim_x],
+                              c->pos[dim_y] + n->dir[dim_y]) !=
+       world.cur_map->terrain(c->pos[dim_x], c->pos[dim_y])) ||
       world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                          [c->pos[dim_x] + n->dir[dim_x]]) {
     n->dir[dim_x] *= -1;
     n->dir[dim_y] *= -1;
   }
 
-  if ((world.cur_map->map[c->pos[dim_y] + n->dir[dim_y]]
-                         [c->pos[dim_x] + n->dir[dim_x]] ==
-       world.cur_map->map[c->pos[dim_y]][c->pos[dim_x]]) &&
+  if ((world.cur_map->terrain(c->pos[dim_x] + n->dir[dim_x],
+                              c->pos[dim_y] + n->dir[dim_y]) ==
+       world.cur_map->terrain(c->pos[dim_x], c->pos[dim_y])) &&
       !world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                           [c->pos[dim_x] + n->dir[dim_x]]) {
     dest[dim_x] = c->pos[dim_x] + n->dir[dim_x];
@@ -134,17 +139,17 @@ static void move_wanderer_func(Character *c, pair_t dest)
       return;
   }
 
-  if ((world.cur_map->map[c->pos[dim_y] + n->dir[dim_y]]
-                         [c->pos[dim_x] + n->dir[dim_x]] !=
-       world.cur_map->map[c->pos[dim_y]][c->pos[dim_x]]) ||
+  if ((world.cur_map->terrain(c->pos[dim_x] + n->dir[dim_x],
+                              c->pos[dim_y] + n->dir[dim_y]) !=
+       world.cur_map->terrain(c->pos[dim_x], c->pos[dim_y])) ||
       world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                          [c->pos[dim_x] + n->dir[dim_x]]) {
     rand_dir(n->dir);
   }
 
-  if ((world.cur_map->map[c->pos[dim_y] + n->dir[dim_y]]
-                         [c->pos[dim_x] + n->dir[dim_x]] ==
-       world.cur_map->map[c->pos[dim_y]][c->pos[dim_x]]) &&
+  if ((world.cur_map->terrain(c->pos[dim_x] + n->dir[dim_x],
+                              c->pos[dim_y] + n->dir[dim_y]) ==
+       world.cur_map->terrain(c->pos[dim_x], c->pos[dim_y])) &&
       !world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                           [c->pos[dim_x] + n->dir[dim_x]]) {
     dest[dim_x] = c->pos[dim_x] + n->dir[dim_x];
@@ -174,20 +179,20 @@ static void move_walker_func(Character *c, pair_t dest)
       return;
   }
 
-  if ((move_cost[char_other][world.cur_map->map[c->pos[dim_y] +
-                                                n->dir[dim_y]]
-                                               [c->pos[dim_x] +
-                                                n->dir[dim_x]]] ==
+  if ((move_cost[char_other][world.cur_map->terrain(c->pos[dim_x] +
+                                                    n->dir[dim_x],
+                                                    c->pos[dim_y] +
+                                                    n->dir[dim_y])] ==
        INT_MAX) || world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                                       [c->pos[dim_x] + n->dir[dim_x]]) {
     n->dir[dim_x] *= -1;
     n->dir[dim_y] *= -1;
   }
 
-  if ((move_cost[char_other][world.cur_map->map[c->pos[dim_y] +
-                                                n->dir[dim_y]]
-                                               [c->pos[dim_x] +
-                                                n->dir[dim_x]]] !=
+  if ((move_cost[char_other][world.cur_map->terrain(c->pos[dim_x] +
+                                                    n->dir[dim_x],
+                                                    c->pos[dim_y] +
+                                                    n->dir[dim_y])] !=
        INT_MAX) &&
       !world.cur_map->cmap[c->pos[dim_y] + n->dir[dim_y]]
                           [c->pos[dim_x] + n->dir[dim_x]]) {
@@ -196,8 +201,47 @@ static void move_walker_func(Character *c, pair_t dest)
   }
 }
 
+/* With no one at the keyboard, the PC wanders: it steps to a random *
+ * neighbor it can enter, battling any undefeated trainer in the way. */
+static void move_pc_random(Character *c, pair_t dest)
+{
+  int i, base, x, y;
+  Npc *n;
+
+  dest[dim_x] = c->pos[dim_x];
+  dest[dim_y] = c->pos[dim_y];
+
+  base = rand() & 0x7;
+  for (i = base; i < 8 + base; i++) {
+    x = c->pos[dim_x] + all_dirs[i & 0x7][dim_x];
+    y = c->pos[dim_y] + all_dirs[i & 0x7][dim_y];
+    if (move_cost[char_pc][world.cur_map->terrain(x, y)] == INT_MAX ||
+        // Same restriction as move_pc_dir(); no diagonal map exits
+        (world.cur_map->terrain(x, y) == ter_exit &&
+         all_dirs[i & 0x7][dim_x] && all_dirs[i & 0x7][dim_y])) {
+      continue;
+    }
+    if (world.cur_map->cmap[y][x]) {
+      if ((n = dynamic_cast<Npc *>(world.cur_map->cmap[y][x])) &&
+          !n->defeated) {
+        io_battle(c, n);
+        return;
+      }
+      continue;
+    }
+    dest[dim_x] = x;
+    dest[dim_y] = y;
+    return;
+  }
+}
+
 static void move_pc_func(Character *c, pair_t dest)
 {
+  if (world.headless) {
+    move_pc_random(c, dest);
+    return;
+  }
+
   io_display();
   io_handle_input(dest);
 }
@@ -212,11 +256,6 @@ void (*move_func[num_movement_types])(Character *, pair_t) = {
   move_pc_func,
 };
 
-int32_t cmp_char_turns(const void *key, const void *with)
-{
-  return ((Character *) key)->next_turn - ((Character *) with)->next_turn;
-}
-
 void delete_character(void *v)
 {
   if (v != &world.pc) {
@@ -224,238 +263,162 @@ void delete_character(void *v)
   }
 }
 
-#define ter_cost(x, y, c) move_cost[c][m->map[y][x]]
+/* Every step costs at most the largest finite move_cost, so open cells *
+ * all lie within that distance of the one being settled, and a circular *
+ * array of buckets indexed by distance, one per possible value, makes   *
+ * a priority queue with O(1) operations (Dial's algorithm).  Must be    *
+ * greater than any finite move_cost.                                    */
+#define PATH_BUCKETS 64
+
+/* The distance maps pathfind() fills, one lane each.  All lanes share *
+ * the source, the grid and the buckets; only their move costs differ, *
+ * so another NPC class costs one more lane, not another pass.         *
+ * Hikers and rivals are the only classes that chase the PC, so theirs *
+ * are the only move_cost rows with a lane.  The PC's would be a map   *
+ * of distances to itself, and the other NPCs wander without one.     */
+typedef struct path_lane {
+  character_type_t ctype;
+  int (*dist)[MAP_X];
+} path_lane_t;
+
+static const path_lane_t path_lane[] = {
+  { char_hiker, world.hiker_dist },
+  { char_rival, world.rival_dist },
+};
 
-static int32_t hiker_cmp(const void *key, const void *with) {
-  return (world.hiker_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.hiker_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
-}
+#define NUM_LANES (sizeof (path_lane) / sizeof (path_lane[0]))
+#define MAP_CELLS (MAP_X * MAP_Y)
 
-static int32_t rival_cmp(const void *key, const void *with) {
-  return (world.rival_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.rival_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
-}
+/* A node is a cell in a lane, numbered lane * MAP_CELLS + y * MAP_X + x; *
+ * NO_NODE ends a bucket's list.                                          */
+#define NO_NODE -1
 
-void pathfind(Map *m)
+static int16_t bucket[PATH_BUCKETS];
+static int16_t next_node[NUM_LANES * MAP_CELLS];
+static int16_t prev_node[NUM_LANES * MAP_CELLS];
+
+static void bucket_push(int16_t n, int32_t dist)
 {
-  heap_t h;
-  uint32_t x, y;
-  static path_t p[MAP_Y][MAP_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    for (y = 0; y < MAP_Y; y++) {
-      for (x = 0; x < MAP_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
-  }
+  int16_t *head = &bucket[dist % PATH_BUCKETS];
 
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      world.hiker_dist[y][x] = world.rival_dist[y][x] = INT_MAX;
-    }
+  prev_node[n] = NO_NODE;
+  if ((next_node[n] = *head) != NO_NODE) {
+    prev_node[*head] = n;
   }
-  world.hiker_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 
-    world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 0;
+  *head = n;
+}
 
-  heap_init(&h, hiker_cmp, NULL);
+static void bucket_remove(int16_t n, int32_t dist)
+{
+  if (prev_node[n] != NO_NODE) {
+    next_node[prev_node[n]] = next_node[n];
+  } else {
+    bucket[dist % PATH_BUCKETS] = next_node[n];
+  }
+  if (next_node[n] != NO_NODE) {
+    prev_node[next_node[n]] = prev_node[n];
+  }
+}
 
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_hiker) != INT_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
+/* Fills every lane's distance map with the cost for its NPC class to   *
+ * get from each cell to the PC.  A step costs the terrain of the cell  *
+ * it leaves.  Only passable interior cells are reached; everything     *
+ * else is INT_MAX.                                                     */
+static void dial_pathfind(Map *m)
+{
+  static const int16_t neighbor[8] = {
+    -MAP_X - 1, -MAP_X, -MAP_X + 1,
+    -1,                  1,
+    MAP_X - 1,   MAP_X,  MAP_X + 1,
+  };
+  static uint8_t open[NUM_LANES * MAP_CELLS];
+  static terrain_type_t map[MAP_Y][MAP_X];
+  terrain_type_t *ter = map[0];
+  int32_t *cost[NUM_LANES];
+  int *d[NUM_LANES];
+  int32_t cur, alt;
+  int16_t c, n, node, lane;
+  int i, x, y, queued;
+
+  for (lane = 0; lane < (int16_t) NUM_LANES; lane++) {
+    cost[lane] = move_cost[path_lane[lane].ctype];
+    d[lane] = path_lane[lane].dist[0];
+  }
+  m->unpack_terrain(map);
+
+  for (c = y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++, c++) {
+      for (lane = 0; lane < (int16_t) NUM_LANES; lane++) {
+        d[lane][c] = INT_MAX;
+        open[lane * MAP_CELLS + c] = (y > 0 && y < MAP_Y - 1 &&
+                                      x > 0 && x < MAP_X - 1 &&
+                                      cost[lane][ter[c]] != INT_MAX);
       }
     }
   }
+  for (i = 0; i < PATH_BUCKETS; i++) {
+    bucket[i] = NO_NODE;
+  }
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
+  c = world.pc.pos[dim_y] * MAP_X + world.pc.pos[dim_x];
+  queued = 0;
+  for (lane = 0; lane < (int16_t) NUM_LANES; lane++) {
+    d[lane][c] = 0;
+    if (open[lane * MAP_CELLS + c]) {
+      bucket_push(lane * MAP_CELLS + c, 0);
+      queued++;
     }
   }
-  heap_delete(&h);
 
-  heap_init(&h, rival_cmp, NULL);
-
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_rival) != INT_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
+  for (cur = 0; queued; cur++) {
+    while ((node = bucket[cur % PATH_BUCKETS]) != NO_NODE) {
+      bucket_remove(node, cur);
+      queued--;
+      open[node] = 0;
+      lane = node / MAP_CELLS;
+      c = node - lane * MAP_CELLS;
+      alt = cur + cost[lane][ter[c]];
+      for (i = 0; i < 8; i++) {
+        n = c + neighbor[i];
+        if (open[node + neighbor[i]] && d[lane][n] > alt) {
+          if (d[lane][n] == INT_MAX) {
+            queued++;
+          } else {
+            bucket_remove(node + neighbor[i], d[lane][n]);
+          }
+          d[lane][n] = alt;
+          bucket_push(node + neighbor[i], alt);
+        }
       }
     }
   }
+}
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
-    }
+/* Terrain never changes once a map is made, so the distance maps only *
+ * go stale when the PC moves or changes maps.  Any such change moves   *
+ * the source every distance is measured from, which changes nearly all *
+ * of them, so there's nothing to gain from repairing the old maps over *
+ * recomputing them; the saving is in not recomputing when the PC       *
+ * hasn't moved, e.g. on the turn after a new map is entered, or after  *
+ * a battle or a menu.                                                   */
+void pathfind(Map *m)
+{
+  static Map *last_map;
+  static pair_t last_idx, last_pos;
+
+  if (m == last_map                                   &&
+      world.cur_idx[dim_x] == last_idx[dim_x]         &&
+      world.cur_idx[dim_y] == last_idx[dim_y]         &&
+      world.pc.pos[dim_x] == last_pos[dim_x]          &&
+      world.pc.pos[dim_y] == last_pos[dim_y]) {
+    return;
   }
-  heap_delete(&h);
+
+  dial_pathfind(m);
+
+  last_map = m;
+  last_idx[dim_x] = world.cur_idx[dim_x];
+  last_idx[dim_y] = world.cur_idx[dim_y];
+  last_pos[dim_x] = world.pc.pos[dim_x];
+  last_pos[dim_y] = world.pc.pos[dim_y];
 }
@@ -14,7 +14,6 @@ class Character;
 /* character is defined in poke327.h to allow an instance of character
  * in world without including character.h in poke327.h                 */
 
-int32_t cmp_char_turns(const void *key, const void *with);
 void delete_character(void *v);
 void pathfind(Map *m);
 
@@ -1,422 +1,1183 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
+#include <cstddef>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <limits>
+#include <thread>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "db_parse.h"
 
-static char *next_token(char *start, char delim)
+/* Bump whenever the cache layout or any of the *_db structs change. */
+#define DB_CACHE_VERSION 8
+#define DB_CACHE_MAGIC   "P327DBC"
+#define DB_NUM_FILES     9
+#define DB_NUM_TABLES    17
+#define DB_PAGE_SIZE     4096
+#define DB_MAX_THREADS   8
+
+#define db_page_align(n) (((n) + DB_PAGE_SIZE - 1) & ~((uint64_t) DB_PAGE_SIZE - 1))
+#define db_table_rows(length, table) ((uint32_t) ((length)[table] /           \
+                                                  db_record_size[table]))
+
+typedef enum db_table {
+  db_pokemon,
+  db_moves,
+  db_pokemon_moves,
+  db_species,
+  db_experience,
+  db_type_names,
+  db_pokemon_stats,
+  db_pokemon_types,
+  db_type_efficacy,
+  /* The rest of pokemon_moves.csv; db_pokemon_moves is its first column */
+  db_pokemon_moves_move_id,
+  db_pokemon_moves_method_id,
+  db_pokemon_moves_level,
+  /* Derived at load time, not read from a file */
+  db_learnset_index,
+  db_learnset,
+  db_pokemon_base,
+  db_type_matrix,
+  db_move_row
+} db_table_t;
+
+static const char *db_files[DB_NUM_FILES] = {
+  "pokemon.csv",
+  "moves.csv",
+  "pokemon_moves.csv",
+  "pokemon_species.csv",
+  "experience.csv",
+  "type_names.csv",
+  "pokemon_stats.csv",
+  "pokemon_types.csv",
+  "type_efficacy.csv",
+};
+
+/* First row of each table filled from its file.  Several tables are *
+ * indexed from 1, so row 0 of those is unused.  Everything else about *
+ * their size comes from the files themselves.                         */
+static const uint32_t db_first_row[DB_NUM_FILES] = {
+  1, 1, 1, 1, 1, 1, 0, 0, 0
+};
+
+static const uint32_t db_record_size[DB_NUM_TABLES] = {
+  sizeof (pokemon_db),
+  sizeof (move_db),
+  sizeof (int16_t),
+  sizeof (pokemon_species_db),
+  sizeof (experience_db),
+  sizeof (char[30]),
+  sizeof (pokemon_stats_db),
+  sizeof (pokemon_types_db),
+  sizeof (type_efficacy_db),
+  sizeof (int16_t),
+  sizeof (int8_t),
+  sizeof (int8_t),
+  sizeof (uint32_t),
+  sizeof (learnset_move_db),
+  sizeof (pokemon_base_db),
+  sizeof (uint8_t[NUM_TYPES + 1]),
+  sizeof (uint16_t),
+};
+
+typedef struct db_source {
+  int64_t size;
+  int64_t mtime;
+} db_source_t;
+
+typedef struct db_section {
+  uint64_t offset;
+  uint64_t length;
+} db_section_t;
+
+/* The cache is an image of the tables meant to be used in place: each *
+ * table starts on its own page, and the header says where.  Everything *
+ * before section must match exactly for the image to be used.         */
+typedef struct db_cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size[DB_NUM_TABLES];
+  db_source_t source[DB_NUM_FILES];
+  db_section_t section[DB_NUM_TABLES];
+} db_cache_header_t;
+
+/* Returns the first of a or b in [s, end), or end.  The SSE2 version  *
+ * tests 16 bytes at a time while a whole block fits, then finishes a  *
+ * byte at a time, so it never reads outside the range it was given,   *
+ * even when other threads are tokenizing the rest of the buffer.      */
+static inline char *db_scan(char *s, char *end, char a, char b)
 {
-  int i;
-  static char *s;
+#ifdef __SSE2__
+  __m128i va, vb, v;
+  unsigned mask;
+
+  va = _mm_set1_epi8(a);
+  vb = _mm_set1_epi8(b);
+
+  for (; end - s >= 16; s += 16) {
+    v = _mm_loadu_si128((const __m128i *) s);
+    if ((mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                               _mm_cmpeq_epi8(v, vb))))) {
+      return s + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (s < end && *s != a && *s != b) {
+    s++;
+  }
 
-  if (start) {
-    s = start;
+  return s;
+}
+
+/* Cursor over a CSV buffer.  Keeps no state outside of itself, so any *
+ * number of threads can tokenize at once.  eol is set once the last   *
+ * field of the current line has been read.                            */
+typedef struct db_csv {
+  char *s;
+  char *end; /* The buffer's terminating null */
+  bool eol;
+} db_csv_t;
+
+/* Moves to the start of the next line, skipping whatever is left of the *
+ * current one.  Returns false at the end of the buffer.                 */
+static bool next_line(db_csv_t *csv)
+{
+  if (!csv->eol) {
+    csv->s = db_scan(csv->s, csv->end, '\n', '\n');
+    if (*csv->s) {
+      csv->s++;
+    }
   }
+  csv->eol = false;
 
-  start = s;
+  return *csv->s;
+}
 
-  for (i = 0; s[i] && s[i] != delim; i++)
-    ;
-  s[i] = '\0';
-  s = s + i + 1;
+/* Null-terminates the next field of the current line and returns it.  *
+ * Past the end of the line, fields are empty.                         */
+static char *next_token(db_csv_t *csv)
+{
+  char *start, *end;
+
+  if (csv->eol) {
+    return (char *) "";
+  }
+
+  start = csv->s;
+  end = db_scan(start, csv->end, ',', '\n');
+  if (*end != ',') {
+    csv->eol = true;
+  }
+  if (*end) {
+    *end++ = '\0';
+  }
+  csv->s = end;
 
   return start;
 }
 
-pokemon_move_db pokemon_moves[528239];
-pokemon_db pokemon[1093];
-char *types[19];
-move_db moves[845];
-pokemon_species_db species[899];
-experience_db experience[601];
-pokemon_stats_db pokemon_stats[6553];
-pokemon_types_db pokemon_types[1676];
-type_efficacy_db type_efficacy[325];
+/* atoi(), minus the locale and whitespace handling a CSV doesn't need */
+static inline int db_atoi(const char *s)
+{
+  int n, neg;
 
-void db_parse(bool print)
+  if ((neg = (*s == '-'))) {
+    s++;
+  }
+  for (n = 0; (unsigned) (*s - '0') < 10; s++) {
+    n = n * 10 + (*s - '0');
+  }
+
+  return neg ? -n : n;
+}
+
+/* The next field as an integer, or -1 if it's empty */
+static inline int next_int(db_csv_t *csv)
 {
-  FILE *f;
-  char line[800];
-  int i;
-  char *tmp;
-  struct stat buf;
-  char *prefix;
-  int prefix_len;
-  int j;
-  int count;
+  char *tmp = next_token(csv);
 
-  i = (strlen(getenv("HOME")) +
-       strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
-  prefix = (char *) malloc(i);
-  strcpy(prefix, getenv("HOME"));
-  strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
+  return *tmp ? db_atoi(tmp) : -1;
+}
 
-  if (stat(prefix, &buf)) {
-    free(prefix);
-    prefix = NULL;
+/* Set by db_narrow() when a value doesn't fit its column */
+static std::atomic<bool> db_overflow;
+
+/* v as a T, for tables stored in columns narrower than an int.  Values *
+ * that don't fit set db_overflow, and the file is refused once it's    *
+ * been parsed, rather than wrapping into some other id.                */
+template <class T>
+static inline T db_narrow(int v)
+{
+  if (v < std::numeric_limits<T>::min() || v > std::numeric_limits<T>::max()) {
+    db_overflow.store(true, std::memory_order_relaxed);
   }
 
-  if (!prefix && !stat("/share/cs327", &buf)) {
-    prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
-  } else if (!prefix) {
-    // Your third location goes here, if needed.
-    // prefix is freed later, so be sure you malloc it
+  return (T) v;
+}
+
+pokemon_moves_db pokemon_moves;
+const pokemon_db *pokemon;
+const char *types[19];
+const move_db *moves;
+const pokemon_species_db *species;
+const experience_db *experience;
+const pokemon_stats_db *pokemon_stats;
+const pokemon_types_db *pokemon_types;
+const type_efficacy_db *type_efficacy;
+const uint32_t *learnset_index;
+const learnset_move_db *learnset;
+int learnset_max_id;
+const pokemon_base_db *pokemon_base;
+int pokemon_base_max_id;
+const uint8_t (*type_matrix)[NUM_TYPES + 1];
+static const uint16_t *move_row;
+static int move_row_max_id;
+int num_pokemon;
+int num_moves;
+int num_pokemon_moves;
+int num_species;
+int num_experience;
+int num_pokemon_stats;
+int num_pokemon_types;
+int num_type_efficacy;
+
+static void db_publish(void *const *t, const uint64_t *length)
+{
+  const learnset_move_db *first;
+  int i;
+
+  ::pokemon = (const pokemon_db *) t[db_pokemon];
+  ::moves = (const move_db *) t[db_moves];
+  ::pokemon_moves.pokemon_id = (const int16_t *) t[db_pokemon_moves];
+  ::pokemon_moves.move_id = (const int16_t *) t[db_pokemon_moves_move_id];
+  ::pokemon_moves.pokemon_move_method_id =
+    (const int8_t *) t[db_pokemon_moves_method_id];
+  ::pokemon_moves.level = (const int8_t *) t[db_pokemon_moves_level];
+  ::species = (const pokemon_species_db *) t[db_species];
+  ::experience = (const experience_db *) t[db_experience];
+  ::pokemon_stats = (const pokemon_stats_db *) t[db_pokemon_stats];
+  ::pokemon_types = (const pokemon_types_db *) t[db_pokemon_types];
+  ::type_efficacy = (const type_efficacy_db *) t[db_type_efficacy];
+  for (i = 1; i <= 18; i++) {
+    ::types[i] = ((const char (*)[30]) t[db_type_names])[i];
   }
+  ::learnset_index = (const uint32_t *) t[db_learnset_index];
+  ::learnset = (const learnset_move_db *) t[db_learnset];
+  ::learnset_max_id = length[db_learnset_index] / sizeof (uint32_t) - 2;
+  ::pokemon_base = (const pokemon_base_db *) t[db_pokemon_base];
+  ::pokemon_base_max_id = length[db_pokemon_base] / sizeof (pokemon_base_db) - 1;
+  ::type_matrix = (const uint8_t (*)[NUM_TYPES + 1]) t[db_type_matrix];
+  ::num_pokemon = db_table_rows(length, db_pokemon) - db_first_row[db_pokemon];
+  ::num_moves = db_table_rows(length, db_moves) - db_first_row[db_moves];
+  ::num_pokemon_moves = (db_table_rows(length, db_pokemon_moves) -
+                         db_first_row[db_pokemon_moves]);
+  ::num_species = db_table_rows(length, db_species) - db_first_row[db_species];
+  ::num_experience = (db_table_rows(length, db_experience) -
+                      db_first_row[db_experience]);
+  ::num_pokemon_stats = (db_table_rows(length, db_pokemon_stats) -
+                         db_first_row[db_pokemon_stats]);
+  ::num_pokemon_types = (db_table_rows(length, db_pokemon_types) -
+                         db_first_row[db_pokemon_types]);
+  ::num_type_efficacy = (db_table_rows(length, db_type_efficacy) -
+                         db_first_row[db_type_efficacy]);
+  ::move_row = (const uint16_t *) t[db_move_row];
+  ::move_row_max_id = db_table_rows(length, db_move_row) - 1;
+
+  /* make_pokemon() rerolls until it finds a species with a move at its *
+   * level.  Learnsets only grow with level, so one species that can   *
+   * fight at level 1 is enough to know that it always finds one.      */
+  for (i = 1; i <= num_species; i++) {
+    if (learnset_lookup(pokemon[i].id, 1, &first)) {
+      return;
+    }
+  }
+  fprintf(stderr, "No pokemon in the pokedex can learn a move at level 1\n");
+  exit(1);
+}
 
-  //No error checking on file load from here on out.  Missing
-  //files are "user error".
-  prefix_len = strlen(prefix);
+/* Dense damage_type x target_type table of type_efficacy.  Pairs the *
+ * CSV doesn't mention are neutral.                                   */
+static void db_build_type_matrix(void **t, uint64_t *length)
+{
+  const type_efficacy_db *te = (const type_efficacy_db *) t[db_type_efficacy];
+  uint8_t (*matrix)[NUM_TYPES + 1];
+  uint32_t i, rows;
+
+  rows = db_table_rows(length, db_type_efficacy);
+  matrix = (uint8_t (*)[NUM_TYPES + 1]) malloc(sizeof (*matrix) *
+                                                (NUM_TYPES + 1));
+  memset(matrix, 100, sizeof (*matrix) * (NUM_TYPES + 1));
+  for (i = 0; i < rows; i++) {
+    if (te[i].damage_type_id >= 1 && te[i].damage_type_id <= NUM_TYPES &&
+        te[i].target_type_id >= 1 && te[i].target_type_id <= NUM_TYPES) {
+      matrix[te[i].damage_type_id][te[i].target_type_id] =
+        te[i].damage_factor;
+    }
+  }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon.csv");
+  t[db_type_matrix] = matrix;
+  length[db_type_matrix] = sizeof (*matrix) * (NUM_TYPES + 1);
+}
 
-  f = fopen(prefix, "r");
+/* Row of moves[] for each move id, 0 (the unused row) for ids *
+ * that aren't in the table.                                   */
+static void db_build_move_rows(void **t, uint64_t *length)
+{
+  const move_db *mv = (const move_db *) t[db_moves];
+  uint16_t *row;
+  int max_id;
+  uint32_t i, rows;
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+  rows = db_table_rows(length, db_moves);
 
-  fgets(line, 80, f);
+  for (max_id = 0, i = 1; i < rows; i++) {
+    if (mv[i].id > max_id) {
+      max_id = mv[i].id;
+    }
+  }
 
-  for (i = 1; i <= 1092; i++) {
-    fgets(line, 80, f);
-    pokemon[i].id = atoi(next_token(line, ','));
-    strncpy(pokemon[i].identifier, next_token(NULL, ','), 30);
-    pokemon[i].species_id = atoi(next_token(NULL, ','));
-    pokemon[i].height = atoi(next_token(NULL, ','));
-    pokemon[i].weight = atoi(next_token(NULL, ','));
-    pokemon[i].base_experience = atoi(next_token(NULL, ','));
-    pokemon[i].order = atoi(next_token(NULL, ','));
-    pokemon[i].is_default = atoi(next_token(NULL, ','));
+  row = (uint16_t *) calloc(max_id + 1, sizeof (*row));
+  for (i = 1; i < rows; i++) {
+    if (mv[i].id > 0) {
+      row[mv[i].id] = i;
+    }
   }
 
-  fclose(f);
+  t[db_move_row] = row;
+  length[db_move_row] = (max_id + 1) * sizeof (*row);
+}
 
-  if (print) {
-    for (i = 0; i < 1092; i++) {
-      /*printf("%d %s %d %d %d %d %d %d\n", pokemon[i].id, pokemon[i].identifier,
-             pokemon[i].species_id, pokemon[i].height, pokemon[i].weight,
-             pokemon[i].base_experience, pokemon[i].order, pokemon[i].is_default);
-             */
+/* Collects each pokemon's base stats, types and capture rate, which are *
+ * spread over three tables, into one row indexed by pokemon id.        */
+static void db_build_pokemon_base(void **t, uint64_t *length)
+{
+  const pokemon_db *pk = (const pokemon_db *) t[db_pokemon];
+  const pokemon_species_db *sp = (const pokemon_species_db *) t[db_species];
+  const pokemon_stats_db *st = (const pokemon_stats_db *) t[db_pokemon_stats];
+  const pokemon_types_db *ty = (const pokemon_types_db *) t[db_pokemon_types];
+  pokemon_base_db *base;
+  int16_t *capture_rate;
+  int max_id, max_species;
+  uint32_t i, pokemon_rows, species_rows, stats_rows, types_rows;
+
+  pokemon_rows = db_table_rows(length, db_pokemon);
+  species_rows = db_table_rows(length, db_species);
+  stats_rows = db_table_rows(length, db_pokemon_stats);
+  types_rows = db_table_rows(length, db_pokemon_types);
+
+  for (max_id = 0, i = 1; i < pokemon_rows; i++) {
+    if (pk[i].id > max_id) {
+      max_id = pk[i].id;
+    }
+  }
+  for (max_species = 0, i = 1; i < species_rows; i++) {
+    if (sp[i].id > max_species) {
+      max_species = sp[i].id;
     }
+  }
 
+  capture_rate = (int16_t *) malloc((max_species + 1) * sizeof (*capture_rate));
+  for (i = 0; i <= (uint32_t) max_species; i++) {
+    capture_rate[i] = -1;
+  }
+  for (i = 1; i < species_rows; i++) {
+    if (sp[i].id >= 0) {
+      capture_rate[sp[i].id] = sp[i].capture_rate;
+    }
   }
 
+  base = (pokemon_base_db *) calloc(max_id + 1, sizeof (*base));
+  for (i = 0; i <= (uint32_t) max_id; i++) {
+    base[i].type_id[0] = base[i].type_id[1] = -1;
+    base[i].capture_rate = -1;
+  }
+  for (i = 1; i < pokemon_rows; i++) {
+    if (pk[i].id >= 0 && pk[i].species_id >= 0 &&
+        pk[i].species_id <= max_species) {
+      base[pk[i].id].capture_rate = capture_rate[pk[i].species_id];
+    }
+  }
+  free(capture_rate);
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("moves.csv") + 1);
-  strcpy(prefix + prefix_len, "moves.csv");
-
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-
-  for (i = 1; i <= 844; i++) {
-    fgets(line, 800, f);
-    moves[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(moves[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    moves[i].generation_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].type_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].power =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].pp =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].accuracy =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].priority =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].target_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].damage_class_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_chance =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_type_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_effect_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    moves[i].super_contest_effect_id =  *tmp ? atoi(tmp) : -1;
-  }
-
-  fclose(f);
-
-  if (print) {
-    printf("PUNCH %s %d",moves[1].identifier,moves[1].power);
-    for (i = 0; i < 844; i++) {
+  for (i = 0; i < stats_rows; i++) {
+    if (st[i].pokemon_id >= 0 && st[i].pokemon_id <= max_id &&
+        st[i].stat_id >= 1 && st[i].stat_id <= 6) {
+      base[st[i].pokemon_id].base_stat[st[i].stat_id - 1] = st[i].base_stat;
+    }
+  }
+  for (i = 0; i < types_rows; i++) {
+    if (ty[i].pokemon_id >= 0 && ty[i].pokemon_id <= max_id &&
+        (ty[i].slot == 1 || ty[i].slot == 2)) {
+      base[ty[i].pokemon_id].type_id[ty[i].slot - 1] = ty[i].type_id;
+    }
+  }
 
+  t[db_pokemon_base] = base;
+  length[db_pokemon_base] = (max_id + 1) * sizeof (*base);
+}
+
+/* Groups the level-up moves (method 1) by pokemon_id, each group sorted *
+ * by level, so that the moves known at a given level are a prefix of   *
+ * the group.  Within a level, moves keep their order in the CSV.       */
+static void db_build_learnsets(void **t, uint64_t *length)
+{
+  const int16_t *pokemon_id = (const int16_t *) t[db_pokemon_moves];
+  const int16_t *move_id = (const int16_t *) t[db_pokemon_moves_move_id];
+  const int8_t *method_id = (const int8_t *) t[db_pokemon_moves_method_id];
+  const int8_t *level = (const int8_t *) t[db_pokemon_moves_level];
+  uint32_t *index, *fill;
+  learnset_move_db *ls, tmp;
+  int max_id;
+  uint32_t i, j, k, rows;
+
+  rows = db_table_rows(length, db_pokemon_moves);
+
+  for (max_id = 0, i = 1; i < rows; i++) {
+    if (method_id[i] == 1 && pokemon_id[i] > max_id) {
+      max_id = pokemon_id[i];
     }
+  }
 
+  index = (uint32_t *) calloc(max_id + 2, sizeof (*index));
+  for (i = 1; i < rows; i++) {
+    if (method_id[i] == 1 && pokemon_id[i] >= 0) {
+      index[pokemon_id[i] + 1]++;
+    }
+  }
+  for (i = 1; i < (uint32_t) max_id + 2; i++) {
+    index[i] += index[i - 1];
   }
 
+  ls = (learnset_move_db *) malloc((index[max_id + 1] ? index[max_id + 1] : 1) *
+                                   sizeof (*ls));
+  fill = (uint32_t *) malloc((max_id + 1) * sizeof (*fill));
+  memcpy(fill, index, (max_id + 1) * sizeof (*fill));
+  for (i = 1; i < rows; i++) {
+    if (method_id[i] == 1 && pokemon_id[i] >= 0) {
+      ls[fill[pokemon_id[i]]].level = level[i];
+      ls[fill[pokemon_id[i]]++].move_id = move_id[i];
+    }
+  }
+  free(fill);
+
+  /* Groups are short (tens of moves), so a stable insertion sort is fine */
+  for (k = 0; k < (uint32_t) max_id + 1; k++) {
+    for (i = index[k] + 1; i < index[k + 1]; i++) {
+      tmp = ls[i];
+      for (j = i; j > index[k] && ls[j - 1].level > tmp.level; j--) {
+        ls[j] = ls[j - 1];
+      }
+      ls[j] = tmp;
+    }
+  }
+
+  t[db_learnset_index] = index;
+  length[db_learnset_index] = (max_id + 2) * sizeof (*index);
+  t[db_learnset] = ls;
+  length[db_learnset] = index[max_id + 1] * sizeof (*ls);
+}
+
+int learnset_lookup(int pokemon_id, int level, const learnset_move_db **first)
+{
+  uint32_t lo, hi, mid;
 
+  if (pokemon_id < 0 || pokemon_id > learnset_max_id) {
+    *first = NULL;
+    return 0;
+  }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_moves.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_moves.csv");
+  /* First move in the group learned above level */
+  lo = learnset_index[pokemon_id];
+  hi = learnset_index[pokemon_id + 1];
+  *first = learnset + lo;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (learnset[mid].level <= level) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
 
-  f = fopen(prefix, "r");
+  return lo - learnset_index[pokemon_id];
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+const move_db *move_lookup(int id)
+{
+  return &moves[(id > 0 && id <= move_row_max_id) ? move_row[id] : 0];
+}
 
-  fgets(line, 800, f);
+static void db_cache_header_init(db_cache_header_t *h, const char *prefix)
+{
+  char path[1024];
+  struct stat buf;
+  int i;
 
-  for (i = 1; i <= 528238; i++) {
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    pokemon_moves[i].pokemon_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].version_group_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].move_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].pokemon_move_method_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].level = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].order = (*tmp != '\n') ? atoi(tmp) : -1;
+  memset(h, 0, sizeof (*h));
+  strcpy(h->magic, DB_CACHE_MAGIC);
+  h->version = DB_CACHE_VERSION;
+
+  for (i = 0; i < DB_NUM_TABLES; i++) {
+    h->record_size[i] = db_record_size[i];
+  }
+  for (i = 0; i < DB_NUM_FILES; i++) {
+    if (prefix) {
+      snprintf(path, sizeof (path), "%s%s", prefix, db_files[i]);
+    }
+    if (prefix && !stat(path, &buf)) {
+      h->source[i].size = buf.st_size;
+      h->source[i].mtime = buf.st_mtime;
+    } else {
+      h->source[i].size = h->source[i].mtime = -1;
+    }
+  }
+}
+
+static char *db_cache_path()
+{
+  char *path;
+  const char *home;
+
+  if (!(home = getenv("HOME"))) {
+    return NULL;
   }
 
-  fclose(f);
+  path = (char *) malloc(strlen(home) + strlen("/.poke327/pokedex.cache") + 1);
+  strcpy(path, home);
+  strcat(path, "/.poke327");
+  mkdir(path, 0755);
+  strcat(path, "/pokedex.cache");
+
+  return path;
+}
+
+/* Maps the image read-only and points the tables into it.  The mapping *
+ * is shared, so every process on the host that loads the same image   *
+ * uses the same physical pages.  It is never unmapped.  Returns 0 on   *
+ * success, else non-zero with the tables untouched.                   */
+/* Missing files leave their tables empty.  That's no image to keep:   *
+ * it would be taken as up to date on every start until the files show *
+ * up, so it's neither written nor accepted.                           */
+static bool db_tables_filled(const uint64_t *length)
+{
+  int i;
 
-  if (print) {
-    for (i = 0; i < 528238; i++) {
-      /*printf("%d %d %d %d %d %d\n",
-             pokemon_moves[i].pokemon_id,
-             pokemon_moves[i].version_group_id,
-             pokemon_moves[i].move_id,
-             pokemon_moves[i].pokemon_move_method_id,
-             pokemon_moves[i].level,
-             pokemon_moves[i].order);*/
+  for (i = 0; i < DB_NUM_FILES; i++) {
+    if (length[i] <= db_first_row[i] * db_record_size[i]) {
+      return false;
     }
+  }
+
+  return length[db_learnset] != 0;
+}
+
+static int db_cache_map(const char *path, const db_cache_header_t *want)
+{
+  const db_cache_header_t *have;
+  void *t[DB_NUM_TABLES];
+  uint64_t length[DB_NUM_TABLES];
+  struct stat buf;
+  char *image;
+  int fd, i;
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return 1;
+  }
+
+  if (fstat(fd, &buf) || (size_t) buf.st_size < sizeof (*have)) {
+    close(fd);
+    return 1;
+  }
 
+  image = (char *) mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return 1;
   }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_species.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_species.csv");
-
-  f = fopen(prefix, "r");
-
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-
-  for (i = 1; i <= 898; i++) {
-    fgets(line, 800, f);
-    species[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(species[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    species[i].generation_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].evolves_from_species_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].evolution_chain_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].color_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].shape_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].habitat_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].gender_rate =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].capture_rate =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].base_happiness =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_baby =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].hatch_counter =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].has_gender_differences =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].growth_rate_id =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].forms_switchable =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_legendary =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].is_mythical =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].order =  *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    species[i].conquest_order =  *tmp ? atoi(tmp) : -1;
-  }
-
-  fclose(f);
-
-  if (print) {
-    for (i = 0; i <= 898; i++) {
-
-      /*printf("%d %s %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d\n",
-             species[i].id,
-             species[i].identifier,
-             species[i].generation_id,
-             species[i].evolves_from_species_id,
-             species[i].evolution_chain_id,
-             species[i].color_id,
-             species[i].shape_id,
-             species[i].habitat_id,
-             species[i].gender_rate,
-             species[i].capture_rate,
-             species[i].base_happiness,
-             species[i].is_baby,
-             species[i].hatch_counter,
-             species[i].has_gender_differences,
-             species[i].growth_rate_id,
-             species[i].forms_switchable,
-             species[i].is_legendary,
-             species[i].is_mythical,
-             species[i].order,
-             species[i].conquest_order);*/
+  have = (const db_cache_header_t *) image;
+  if (memcmp(have, want, offsetof(db_cache_header_t, section))) {
+    munmap(image, buf.st_size);
+    return 1;
+  }
 
+  for (i = 0; i < DB_NUM_TABLES; i++) {
+    if ((i < DB_NUM_FILES &&
+         have->section[i].length < db_first_row[i] * db_record_size[i])   ||
+        ((i == db_type_names || i == db_type_matrix) &&
+         have->section[i].length != (NUM_TYPES + 1) * db_record_size[i]) ||
+        (i >= db_pokemon_moves_move_id && i <= db_pokemon_moves_level &&
+         (have->section[i].length / db_record_size[i] !=
+          have->section[db_pokemon_moves].length /
+          db_record_size[db_pokemon_moves]))                             ||
+        have->section[i].length % db_record_size[i]                       ||
+        have->section[i].offset + have->section[i].length >
+        (uint64_t) buf.st_size) {
+      munmap(image, buf.st_size);
+      return 1;
     }
+    t[i] = image + have->section[i].offset;
+    length[i] = have->section[i].length;
   }
 
+  if (!db_tables_filled(length)) {
+    munmap(image, buf.st_size);
+    return 1;
+  }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("experience.csv") + 1);
-  strcpy(prefix + prefix_len, "experience.csv");
+  db_publish(t, length);
 
-  f = fopen(prefix, "r");
+  return 0;
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+/* Failure to write the cache only costs us the CSV parse next time. */
+static void db_cache_store(const char *path, db_cache_header_t *h,
+                           void *const *t, const uint64_t *length)
+{
+  char *tmp;
+  uint64_t offset;
+  int fd, i, failed;
+
+  offset = db_page_align(sizeof (*h));
+  for (i = 0; i < DB_NUM_TABLES; i++) {
+    h->section[i].offset = offset;
+    h->section[i].length = length[i];
+    offset = db_page_align(offset + length[i]);
+  }
 
-  fgets(line, 800, f);
+  tmp = (char *) malloc(strlen(path) + strlen(".tmp") + 1);
+  strcpy(tmp, path);
+  strcat(tmp, ".tmp");
 
-  for (i = 1; i <= 600; i++) {
-    fgets(line, 800, f);
-    experience[i].growth_rate_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    experience[i].level = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    experience[i].experience =  *tmp ? atoi(tmp) : -1;
+  if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    free(tmp);
+    return;
   }
 
-  fclose(f);
+  failed = (ftruncate(fd, offset) ||
+            pwrite(fd, h, sizeof (*h), 0) != sizeof (*h));
+  for (i = 0; !failed && i < DB_NUM_TABLES; i++) {
+    failed = (pwrite(fd, t[i], h->section[i].length, h->section[i].offset) !=
+              (ssize_t) h->section[i].length);
+  }
 
-  if (print) {
-    for (i = 0; i <= 600; i++) {
-      /*printf("%d %d %d\n",
-             experience[i].growth_rate_id,
-             experience[i].level,
-             experience[i].experience);*/
-    }
+  // Written under a temporary name so a concurrent reader never
+  // sees a partial image.
+  if (close(fd) || failed || rename(tmp, path)) {
+    unlink(tmp);
+  }
+
+  free(tmp);
+}
+
+
+/* Each of these parses up to rows lines of its file, starting at s, into *
+ * row onward of its table(s) in t.  They touch nothing else, so disjoint *
+ * pieces of the same table may be parsed concurrently.                   */
+typedef void (*db_parser_t)(char *s, char *end, void *const *t,
+                            uint32_t row, uint32_t rows);
 
+static void db_parse_pokemon(char *s, char *end, void *const *t,
+                             uint32_t row, uint32_t rows)
+{
+  pokemon_db *pokemon = (pokemon_db *) t[db_pokemon];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    pokemon[i].id = db_atoi(next_token(&csv));
+    strncpy(pokemon[i].identifier, next_token(&csv), 30);
+    pokemon[i].species_id = db_atoi(next_token(&csv));
+    pokemon[i].height = db_atoi(next_token(&csv));
+    pokemon[i].weight = db_atoi(next_token(&csv));
+    pokemon[i].base_experience = db_atoi(next_token(&csv));
+    pokemon[i].order = db_atoi(next_token(&csv));
+    pokemon[i].is_default = db_atoi(next_token(&csv));
   }
+}
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("type_names.csv") + 1);
-  strcpy(prefix + prefix_len, "type_names.csv");
+static void db_parse_moves(char *s, char *end, void *const *t,
+                           uint32_t row, uint32_t rows)
+{
+  move_db *moves = (move_db *) t[db_moves];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    moves[i].id = db_atoi(next_token(&csv));
+    strcpy(moves[i].identifier, next_token(&csv));
+    moves[i].generation_id = next_int(&csv);
+    moves[i].type_id = next_int(&csv);
+    moves[i].power = next_int(&csv);
+    moves[i].pp = next_int(&csv);
+    moves[i].accuracy = next_int(&csv);
+    moves[i].priority = next_int(&csv);
+    moves[i].target_id = next_int(&csv);
+    moves[i].damage_class_id = next_int(&csv);
+    moves[i].effect_id = next_int(&csv);
+    moves[i].effect_chance = next_int(&csv);
+    moves[i].contest_type_id = next_int(&csv);
+    moves[i].contest_effect_id = next_int(&csv);
+    moves[i].super_contest_effect_id = next_int(&csv);
+  }
+}
 
-  f = fopen(prefix, "r");
+static void db_parse_pokemon_moves(char *s, char *end, void *const *t,
+                                   uint32_t row, uint32_t rows)
+{
+  int16_t *pokemon_id = (int16_t *) t[db_pokemon_moves];
+  int16_t *move_id = (int16_t *) t[db_pokemon_moves_move_id];
+  int8_t *method_id = (int8_t *) t[db_pokemon_moves_method_id];
+  int8_t *level = (int8_t *) t[db_pokemon_moves_level];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  /* version_group_id and order aren't kept */
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    pokemon_id[i] = db_narrow<int16_t>(next_int(&csv));
+    next_token(&csv);
+    move_id[i] = db_narrow<int16_t>(next_int(&csv));
+    method_id[i] = db_narrow<int8_t>(next_int(&csv));
+    level[i] = db_narrow<int8_t>(next_int(&csv));
+  }
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+static void db_parse_species(char *s, char *end, void *const *t,
+                             uint32_t row, uint32_t rows)
+{
+  pokemon_species_db *species = (pokemon_species_db *) t[db_species];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    species[i].id = db_atoi(next_token(&csv));
+    strcpy(species[i].identifier, next_token(&csv));
+    species[i].generation_id = next_int(&csv);
+    species[i].evolves_from_species_id = next_int(&csv);
+    species[i].evolution_chain_id = next_int(&csv);
+    species[i].color_id = next_int(&csv);
+    species[i].shape_id = next_int(&csv);
+    species[i].habitat_id = next_int(&csv);
+    species[i].gender_rate = next_int(&csv);
+    species[i].capture_rate = next_int(&csv);
+    species[i].base_happiness = next_int(&csv);
+    species[i].is_baby = next_int(&csv);
+    species[i].hatch_counter = next_int(&csv);
+    species[i].has_gender_differences = next_int(&csv);
+    species[i].growth_rate_id = next_int(&csv);
+    species[i].forms_switchable = next_int(&csv);
+    species[i].is_legendary = next_int(&csv);
+    species[i].is_mythical = next_int(&csv);
+    species[i].order = next_int(&csv);
+    species[i].conquest_order = next_int(&csv);
+  }
+}
 
-  fgets(line, 800, f);
+static void db_parse_experience(char *s, char *end, void *const *t,
+                                uint32_t row, uint32_t rows)
+{
+  experience_db *experience = (experience_db *) t[db_experience];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    experience[i].growth_rate_id = db_atoi(next_token(&csv));
+    experience[i].level = next_int(&csv);
+    experience[i].experience = next_int(&csv);
+  }
+}
 
-  for (i = 1; i <= 18; i++) {
+/* type_names.csv has ten lines per type, one per language; the eighth *
+ * is English.                                                          */
+static void db_parse_type_names(char *s, char *end, void *const *t,
+                                uint32_t row, uint32_t rows)
+{
+  char (*type_name_buf)[30] = (char (*)[30]) t[db_type_names];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+  int j;
 
-    fgets(line, 800, f); //  1
-    fgets(line, 800, f); //  3
-    fgets(line, 800, f); //  4
-    fgets(line, 800, f); //  5
-    fgets(line, 800, f); //  6
-    fgets(line, 800, f); //  7
-    fgets(line, 800, f); //  8
-    fgets(line, 800, f); //  9 - English
-    for (j = count = 0; count < 2; j++) {
-      if (line[j] == ',') {
-        count++;
+  for (i = row; i < row + rows; i++) {
+    for (j = 0; j < 10 && next_line(&csv); j++) {
+      if (j == 7) {
+        next_token(&csv);
+        next_token(&csv);
+        strncpy(type_name_buf[i], next_token(&csv),
+                sizeof (type_name_buf[i]) - 1);
       }
     }
-    line[strlen(line) - 1] = '\0';
-    types[i] = strdup(line + j);
-    fgets(line, 800, f); // 11
-    fgets(line, 800, f); // 12
   }
+}
+
+static void db_parse_pokemon_stats(char *s, char *end, void *const *t,
+                                   uint32_t row, uint32_t rows)
+{
+  pokemon_stats_db *pokemon_stats = (pokemon_stats_db *) t[db_pokemon_stats];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    pokemon_stats[i].pokemon_id = next_int(&csv);
+    pokemon_stats[i].stat_id = next_int(&csv);
+    pokemon_stats[i].base_stat = next_int(&csv);
+    pokemon_stats[i].effort = next_int(&csv);
+  }
+}
+
+static void db_parse_pokemon_types(char *s, char *end, void *const *t,
+                                   uint32_t row, uint32_t rows)
+{
+  pokemon_types_db *pokemon_types = (pokemon_types_db *) t[db_pokemon_types];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    pokemon_types[i].pokemon_id = next_int(&csv);
+    pokemon_types[i].type_id = next_int(&csv);
+    pokemon_types[i].slot = next_int(&csv);
+  }
+}
+
+static void db_parse_type_efficacy(char *s, char *end, void *const *t,
+                                   uint32_t row, uint32_t rows)
+{
+  type_efficacy_db *type_efficacy = (type_efficacy_db *) t[db_type_efficacy];
+  db_csv_t csv = { s, end, true };
+  uint32_t i;
+
+  for (i = row; i < row + rows && next_line(&csv); i++) {
+    type_efficacy[i].damage_type_id = next_int(&csv);
+    type_efficacy[i].target_type_id = next_int(&csv);
+    type_efficacy[i].damage_factor = next_int(&csv);
+  }
+}
 
-  fclose(f);
+static const db_parser_t db_parsers[DB_NUM_FILES] = {
+  db_parse_pokemon,
+  db_parse_moves,
+  db_parse_pokemon_moves,
+  db_parse_species,
+  db_parse_experience,
+  db_parse_type_names,
+  db_parse_pokemon_stats,
+  db_parse_pokemon_types,
+  db_parse_type_efficacy,
+};
+
+/* Reads all of path into a null-terminated buffer, or returns NULL. */
+static char *db_read_file(const char *path, size_t *size)
+{
+  struct stat buf;
+  char *data;
+  ssize_t n;
+  size_t len;
+  int fd;
 
-  if (print) {
-    for (i = 1; i <= 18; i++) {
-      //printf("%s\n", types[i]);
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &buf)) {
+    close(fd);
+    return NULL;
+  }
+
+  data = (char *) malloc(buf.st_size + 1);
+  for (len = 0; len < (size_t) buf.st_size; len += n) {
+    if ((n = read(fd, data + len, buf.st_size - len)) <= 0) {
+      break;
     }
   }
+  close(fd);
+  data[len] = '\0';
 
+  if (size) {
+    *size = len;
+  }
+
+  return data;
+}
+
+/* Skips the header line */
+static char *db_first_line(char *data)
+{
+  char *s;
+
+  return (s = strchr(data, '\n')) ? s + 1 : data + strlen(data);
+}
+
+/* Lines in s up to end, the last one with or without its newline */
+static uint32_t db_count_lines(const char *s, const char *end)
+{
+  uint32_t lines;
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_stats.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_stats.csv");
-  f = fopen(prefix, "r");
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-
-  fgets(line, 800, f);
-
-  for( i = 0; i <= 6552; i++)
-  {
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    pokemon_stats[i].pokemon_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].stat_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].base_stat = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].effort = *tmp ? atoi(tmp) : -1;
-
-  }
-  fclose(f);
-  if(print){
-    for(i = 0; i < 6552; i++){
-      /*
-        printf("%d %d %d %d\n",
-        pokemon_stats[i].pokemon_id,
-        pokemon_stats[i].stat_id,
-        pokemon_stats[i].base_stat,
-        pokemon_stats[i].effort);
-        */
+  for (lines = 0; s < end; lines++) {
+    s = (const char *) memchr(s, '\n', end - s);
+    s = s ? s + 1 : end;
+  }
+
+  return lines;
+}
+
+/* Allocates a file's table(s) with room for rows records past its first row */
+static void db_alloc_table(db_table_t table, uint32_t rows,
+                           void **t, uint64_t *length)
+{
+  int i;
+
+  rows += db_first_row[table];
+  t[table] = calloc(rows ? rows : 1, db_record_size[table]);
+  length[table] = (uint64_t) rows * db_record_size[table];
+
+  if (table == db_pokemon_moves) {
+    for (i = db_pokemon_moves_move_id; i <= db_pokemon_moves_level; i++) {
+      t[i] = calloc(rows ? rows : 1, db_record_size[i]);
+      length[i] = (uint64_t) rows * db_record_size[i];
     }
   }
+}
+
+/* A piece of parsing work.  A job with no start reads its whole file *
+ * and sizes its table from it; otherwise it parses rows lines at     *
+ * start into a table that's already allocated, a piece of a file     *
+ * that was read and split up front.                                  */
+typedef struct db_job {
+  db_table_t table;
+  char *start;
+  char *end;
+  uint32_t row;
+  uint32_t rows;
+} db_job_t;
+
+typedef struct db_pool {
+  db_job_t *job;
+  int num_jobs;
+  std::atomic<int> next_job;
+  const char *prefix;
+  void **t;
+  uint64_t *length;
+} db_pool_t;
+
+static void db_run_job(const db_pool_t *pool, db_job_t *job)
+{
+  char path[1024];
+  char *data, *s;
+  size_t size;
+  uint32_t rows;
+
+  if (job->start) {
+    db_parsers[job->table](job->start, job->end, pool->t, job->row,
+                           job->rows);
+    return;
+  }
 
+  data = NULL;
+  if (pool->prefix) {
+    snprintf(path, sizeof (path), "%s%s", pool->prefix, db_files[job->table]);
+    data = db_read_file(path, &size);
+  }
+  s = data ? db_first_line(data) : NULL;
+
+  /* The type names are tied to the type matrix, so their number is fixed */
+  if (job->table == db_type_names) {
+    rows = NUM_TYPES;
+  } else {
+    rows = s ? db_count_lines(s, data + size) : 0;
+  }
+  db_alloc_table(job->table, rows, pool->t, pool->length);
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon_types.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_types.csv");
-  f = fopen(prefix, "r");
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-  fgets(line, 800, f);
-  for(i = 0; i < 1676; i++)
-  {
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    pokemon_types[i].pokemon_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_types[i].type_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    pokemon_types[i].slot = *tmp ? atoi(tmp) : -1;
-  }
-  fclose(f);
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("type_efficacy.csv") + 1);
-  strcpy(prefix + prefix_len, "type_efficacy.csv");
-  f = fopen(prefix, "r");
-  prefix = (char *) realloc(prefix, prefix_len + 1);
-  fgets(line, 800, f);
-  for(i = 0; i < 325; i++){
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    type_efficacy[i].damage_type_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    type_efficacy[i].target_type_id = *tmp ? atoi(tmp) : -1;
-    tmp = next_token(NULL, ',');
-    type_efficacy[i].damage_factor = *tmp ? atoi(tmp) : -1;
+  if (data) {
+    db_parsers[job->table](s, data + size, pool->t, db_first_row[job->table],
+                           rows);
+    free(data);
   }
+}
 
+static void db_worker(db_pool_t *pool)
+{
+  int i;
+
+  while ((i = pool->next_job++) < pool->num_jobs) {
+    db_run_job(pool, pool->job + i);
+  }
+}
+
+/* Splits the body of pokemon_moves.csv, by far the largest file, into *
+ * pieces of about the same size on line boundaries, one job each.     *
+ * The pieces are null-terminated in place, and each job is told the   *
+ * row its first line goes to.  Returns the number of jobs and sets    *
+ * *rows to the number of lines in all of them.                        */
+static int db_split_file(db_table_t table, char *data, size_t size,
+                         int pieces, db_job_t *job, uint32_t *rows)
+{
+  char *s, *end, *split, *nl;
+  uint32_t row;
+  int n;
+
+  s = db_first_line(data);
+  end = data + size;
+  row = db_first_row[table];
+
+  for (n = 0; n < pieces && s < end; n++) {
+    split = (n == pieces - 1) ? end : s + (end - s) / (pieces - n);
+    if (split < end && (nl = (char *) memchr(split, '\n', end - split))) {
+      split = nl + 1;
+    } else {
+      split = end;
+    }
+
+    job[n].table = table;
+    job[n].start = s;
+    job[n].row = row;
+    job[n].rows = db_count_lines(s, split);
+    if (split < end) {
+      split[-1] = '\0';
+      job[n].end = split - 1;
+    } else {
+      job[n].end = end;
+    }
+
+    row += job[n].rows;
+    s = split;
+  }
+
+  *rows = row - db_first_row[table];
+
+  return n;
+}
+
+void db_parse(bool print)
+{
+  db_cache_header_t header;
+  char *cache;
+  void *t[DB_NUM_TABLES];
+  uint64_t length[DB_NUM_TABLES];
+  db_job_t job[DB_NUM_FILES + DB_MAX_THREADS];
+  db_pool_t pool;
+  std::thread thread[DB_MAX_THREADS];
+  int num_threads;
+  char path[1024];
+  char *big;
+  size_t big_size;
+  uint32_t big_rows;
+  int i;
+  struct stat buf;
+  char *prefix;
+
+  i = (strlen(getenv("HOME")) +
+       strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
+  prefix = (char *) malloc(i);
+  strcpy(prefix, getenv("HOME"));
+  strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
+
+  if (stat(prefix, &buf)) {
+    free(prefix);
+    prefix = NULL;
+  }
+
+  if (!prefix && !stat("/share/cs327", &buf)) {
+    prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
+  } else if (!prefix) {
+    // Your third location goes here, if needed.
+    // prefix is freed later, so be sure you malloc it
+  }
+
+  db_cache_header_init(&header, prefix);
+  cache = db_cache_path();
+  if (cache && !db_cache_map(cache, &header)) {
+    free(cache);
+    free(prefix);
+    return;
+  }
+
+  //No error checking on file load from here on out.  Missing
+  //files are "user error", and leave their tables empty.
+  num_threads = std::thread::hardware_concurrency();
+  if (num_threads < 1) {
+    num_threads = 1;
+  } else if (num_threads > DB_MAX_THREADS) {
+    num_threads = DB_MAX_THREADS;
+  }
+
+  /* The big file goes first, so the small ones fill in around it. */
+  big = NULL;
+  if (prefix) {
+    snprintf(path, sizeof (path), "%s%s", prefix, db_files[db_pokemon_moves]);
+    big = db_read_file(path, &big_size);
+  }
+  pool.num_jobs = 0;
+  big_rows = 0;
+  if (big) {
+    pool.num_jobs = db_split_file(db_pokemon_moves, big, big_size,
+                                  num_threads, job, &big_rows);
+  }
+  db_alloc_table(db_pokemon_moves, big_rows, t, length);
+  for (i = 0; i < DB_NUM_FILES; i++) {
+    if (i != db_pokemon_moves) {
+      job[pool.num_jobs].table = (db_table_t) i;
+      job[pool.num_jobs++].start = NULL;
+    }
+  }
+
+  pool.job = job;
+  pool.next_job = 0;
+  pool.prefix = prefix;
+  pool.t = t;
+  pool.length = length;
+
+  for (i = 1; i < num_threads; i++) {
+    thread[i] = std::thread(db_worker, &pool);
+  }
+  db_worker(&pool);
+  for (i = 1; i < num_threads; i++) {
+    thread[i].join();
+  }
+
+  /* Nothing can be made without learnsets, so this can't be skipped */
+  if (db_overflow) {
+    fprintf(stderr, "%s: values too large for the pokemon_moves columns\n",
+            path);
+    exit(1);
+  }
+
+  free(big);
   free(prefix);
+
+  if (print && length[db_moves] > sizeof (move_db)) {
+    printf("PUNCH %s %d", ((move_db *) t[db_moves])[1].identifier,
+           ((move_db *) t[db_moves])[1].power);
+  }
+
+  db_build_learnsets(t, length);
+  db_build_pokemon_base(t, length);
+  db_build_type_matrix(t, length);
+  db_build_move_rows(t, length);
+
+  /* Prefer the freshly written image over our private copies, so this *
+   * process shares pages with every later one.                        */
+  if (cache && !db_tables_filled(length)) {
+    free(cache);
+    cache = NULL;
+  }
+  if (cache) {
+    db_cache_store(cache, &header, t, length);
+  }
+  if (cache && !db_cache_map(cache, &header)) {
+    for (i = 0; i < DB_NUM_TABLES; i++) {
+      free(t[i]);
+    }
+  } else {
+    db_publish(t, length);
+  }
+  free(cache);
 }
@@ -1,6 +1,10 @@
 #ifndef DB_PARSE_H
 # define DB_PARSE_H
 
+# include <stdint.h>
+
+# define NUM_TYPES 18
+
 struct pokemon_db {
   int id;
   char identifier[30];
@@ -31,13 +35,28 @@ struct move_db {
   int super_contest_effect_id;
 };
 
-struct pokemon_move_db {
-  int pokemon_id;
-  int version_group_id;
-  int move_id;
-  int pokemon_move_method_id;
+/* pokemon_moves.csv by column, narrowed to the columns the game reads; *
+ * row i is pokemon_id[i], move_id[i], and so on.                       */
+struct pokemon_moves_db {
+  const int16_t *pokemon_id;
+  const int16_t *move_id;
+  const int8_t *pokemon_move_method_id;
+  const int8_t *level;
+};
+
+/* One level-up move in a pokemon's learnset; see learnset_lookup(). */
+struct learnset_move_db {
   int level;
-  int order;
+  int move_id;
+};
+
+/* Everything needed to build a Pokemon of a given pokemon id that *
+ * isn't per-move.  base_stat is indexed by stat_id - 1, type_id by *
+ * slot - 1; missing values are -1 (0 for stats).                   */
+struct pokemon_base_db {
+  int16_t base_stat[6];
+  int16_t type_id[2];
+  int16_t capture_rate;
 };
 
 struct pokemon_species_db {
@@ -88,15 +107,70 @@ struct type_efficacy_db {
   int damage_factor;
 };
 
-extern pokemon_stats_db pokemon_stats[6553];
-extern pokemon_move_db pokemon_moves[528239];
-extern pokemon_db pokemon[1093];
-extern char *types[19];
-extern move_db moves[845];
-extern pokemon_species_db species[899];
-extern experience_db experience[601];
-extern pokemon_types_db pokemon_types[1676];
-extern type_efficacy_db type_efficacy[325];
+/* Read-only.  These normally point into a memory-mapped image of the *
+ * pokedex shared by every process on the host; see db_parse().       */
+extern const pokemon_stats_db *pokemon_stats;
+extern pokemon_moves_db pokemon_moves;
+extern const pokemon_db *pokemon;
+extern const char *types[19];
+extern const move_db *moves;
+extern const pokemon_species_db *species;
+extern const experience_db *experience;
+extern const pokemon_types_db *pokemon_types;
+extern const type_efficacy_db *type_efficacy;
+
+/* Number of records in each table above, as found in the files.  The *
+ * tables indexed from 1 (pokemon, moves, pokemon_moves, species and   *
+ * experience) run from [1] through [num_*]; the rest from [0] through *
+ * [num_* - 1].  types always has NUM_TYPES names, from [1].           */
+extern int num_pokemon;
+extern int num_moves;
+extern int num_pokemon_moves;
+extern int num_species;
+extern int num_experience;
+extern int num_pokemon_stats;
+extern int num_pokemon_types;
+extern int num_type_efficacy;
+
+/* Level-up moves indexed by pokemon_id: the moves of pokemon_id are  *
+ * learnset[learnset_index[pokemon_id]] up to, but not including,    *
+ * learnset[learnset_index[pokemon_id + 1]], sorted by level.        */
+extern const uint32_t *learnset_index;
+extern const learnset_move_db *learnset;
+extern int learnset_max_id;
+
+/* Indexed by pokemon id, 0 through pokemon_base_max_id */
+extern const pokemon_base_db *pokemon_base;
+extern int pokemon_base_max_id;
+
+/* Damage factor in percent, indexed [damage_type_id][target_type_id] */
+extern const uint8_t (*type_matrix)[NUM_TYPES + 1];
+
 void db_parse(bool print);
 
+/* Sets *first to the level-up moves pokemon_id knows at level and *
+ * returns how many there are.                                     */
+int learnset_lookup(int pokemon_id, int level, const learnset_move_db **first);
+
+/* The row of moves[] with the given id, or the unused row 0 if none does */
+const move_db *move_lookup(int id);
+
+/* Damage factor, in percent, of a damage_type attack against target_type. *
+ * Unknown types (e.g. an empty second slot, -1) are neutral.             */
+inline int type_damage_factor(int damage_type, int target_type)
+{
+  return ((damage_type >= 1 && damage_type <= NUM_TYPES &&
+           target_type >= 1 && target_type <= NUM_TYPES) ?
+          type_matrix[damage_type][target_type]           :
+          100);
+}
+
+/* As above, against a dual-typed target */
+inline int type_damage_factor(int damage_type,
+                              int target_type1, int target_type2)
+{
+  return (type_damage_factor(damage_type, target_type1) *
+          type_damage_factor(damage_type, target_type2)) / 100;
+}
+
 #endif
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dheap.h"
+
+#define DHEAP_ARITY 4
+
+#define dheap_parent(i) (((i) - 1) / DHEAP_ARITY)
+#define dheap_child(i)  ((i) * DHEAP_ARITY + 1)
+
+/* Handles move only when they're freed and reused, so callers can hold *
+ * on to them; pos is kept up to date as the heap shuffles entries.     *
+ * next only holds the pool's free list link.                           */
+struct dheap_node {
+  dheap_node_t *next;
+  uint32_t pos;
+};
+
+/* The datum is kept in the array, beside its handle, so comparisons *
+ * don't have to go through the handle.                              */
+struct dheap_entry {
+  void *datum;
+  dheap_node_t *node;
+};
+
+#define DHEAP_MIN_CAPACITY 16
+
+void dheap_init(dheap_t *h,
+                int32_t (*compare)(const void *key, const void *with),
+                void (*datum_delete)(void *))
+{
+  h->a = NULL;
+  h->size = 0;
+  h->capacity = 0;
+  h->compare = compare;
+  h->datum_delete = datum_delete;
+  node_pool_init(&h->nodes, sizeof (dheap_node_t));
+}
+
+void dheap_delete(dheap_t *h)
+{
+  uint32_t i;
+
+  if (h->datum_delete) {
+    for (i = 0; i < h->size; i++) {
+      h->datum_delete(h->a[i].datum);
+    }
+  }
+  node_pool_delete(&h->nodes);
+  free(h->a);
+  h->a = NULL;
+  h->size = 0;
+  h->capacity = 0;
+  h->compare = NULL;
+  h->datum_delete = NULL;
+}
+
+static void dheap_sift_up(dheap_t *h, uint32_t i)
+{
+  struct dheap_entry e;
+  uint32_t p;
+
+  e = h->a[i];
+  while (i && h->compare(e.datum, h->a[p = dheap_parent(i)].datum) < 0) {
+    h->a[i] = h->a[p];
+    h->a[i].node->pos = i;
+    i = p;
+  }
+  h->a[i] = e;
+  e.node->pos = i;
+}
+
+static void dheap_sift_down(dheap_t *h, uint32_t i)
+{
+  struct dheap_entry e;
+  uint32_t c, min, end;
+
+  e = h->a[i];
+  while ((c = dheap_child(i)) < h->size) {
+    end = c + DHEAP_ARITY < h->size ? c + DHEAP_ARITY : h->size;
+    for (min = c++; c < end; c++) {
+      if (h->compare(h->a[c].datum, h->a[min].datum) < 0) {
+        min = c;
+      }
+    }
+    if (h->compare(h->a[min].datum, e.datum) >= 0) {
+      break;
+    }
+    h->a[i] = h->a[min];
+    h->a[i].node->pos = i;
+    i = min;
+  }
+  h->a[i] = e;
+  e.node->pos = i;
+}
+
+dheap_node_t *dheap_insert(dheap_t *h, void *v)
+{
+  dheap_node_t *n;
+
+  if (h->size == h->capacity) {
+    h->capacity = h->capacity ? h->capacity * 2 : DHEAP_MIN_CAPACITY;
+    h->a = realloc(h->a, h->capacity * sizeof (*h->a));
+    assert(h->a);
+  }
+
+  n = (dheap_node_t *) node_pool_alloc(&h->nodes);
+  h->a[h->size].datum = v;
+  h->a[h->size].node = n;
+  dheap_sift_up(h, h->size++);
+
+  return n;
+}
+
+void *dheap_peek_min(dheap_t *h)
+{
+  return h->size ? h->a[0].datum : NULL;
+}
+
+void *dheap_remove_min(dheap_t *h)
+{
+  void *v;
+
+  if (!h->size) {
+    return NULL;
+  }
+
+  v = h->a[0].datum;
+  node_pool_free(&h->nodes, h->a[0].node);
+  if (--h->size) {
+    h->a[0] = h->a[h->size];
+    dheap_sift_down(h, 0);
+  }
+
+  return v;
+}
+
+int dheap_decrease_key(dheap_t *h, dheap_node_t *n, void *v)
+{
+  if (h->compare(h->a[n->pos].datum, v) <= 0) {
+    return 1;
+  }
+
+  if (h->datum_delete) {
+    h->datum_delete(h->a[n->pos].datum);
+  }
+  h->a[n->pos].datum = v;
+
+  return dheap_decrease_key_no_replace(h, n);
+}
+
+int dheap_decrease_key_no_replace(dheap_t *h, dheap_node_t *n)
+{
+  /* As with heap_decrease_key_no_replace(), the key changed in place, *
+   * so it's on the caller to make sure it didn't increase.            */
+  dheap_sift_up(h, n->pos);
+
+  return 0;
+}
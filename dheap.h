@@ -0,0 +1,45 @@
+#ifndef DHEAP_H
+# define DHEAP_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+# include <stdint.h>
+
+# include "node_pool.h"
+
+/* A 4-ary min-heap in one contiguous array, with the same interface as *
+ * heap.h.  Each inserted datum gets a handle that always knows where   *
+ * the datum is in the array, for decrease key.  Cheaper than the       *
+ * Fibonacci heap for the small, dense queues in this game; there is no *
+ * combine.                                                             */
+
+struct dheap_node;
+typedef struct dheap_node dheap_node_t;
+struct dheap_entry;
+
+typedef struct dheap {
+  struct dheap_entry *a;
+  uint32_t size;
+  uint32_t capacity;
+  int32_t (*compare)(const void *key, const void *with);
+  void (*datum_delete)(void *);
+  node_pool_t nodes;
+} dheap_t;
+
+void dheap_init(dheap_t *h,
+                int32_t (*compare)(const void *key, const void *with),
+                void (*datum_delete)(void *));
+void dheap_delete(dheap_t *h);
+dheap_node_t *dheap_insert(dheap_t *h, void *v);
+void *dheap_peek_min(dheap_t *h);
+void *dheap_remove_min(dheap_t *h);
+int dheap_decrease_key(dheap_t *h, dheap_node_t *n, void *v);
+int dheap_decrease_key_no_replace(dheap_t *h, dheap_node_t *n);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
@@ -99,8 +99,25 @@ void heap_init(heap_t *h,
   h->size = 0;
   h->compare = compare;
   h->datum_delete = datum_delete;
+  node_pool_init(&h->nodes, sizeof (heap_node_t));
 }
 
+static heap_node_t *heap_node_alloc(heap_t *h)
+{
+  heap_node_t *n;
+
+  n = (heap_node_t *) node_pool_alloc(&h->nodes);
+  memset(n, 0, sizeof (*n));
+
+  return n;
+}
+
+static void heap_node_free(heap_t *h, heap_node_t *n)
+{
+  node_pool_free(&h->nodes, n);
+}
+
+/* Only needed to delete the data; the nodes go with their pool. */
 void heap_node_delete(heap_t *h, heap_node_t *hn)
 {
   heap_node_t *next;
@@ -114,16 +131,16 @@ void heap_node_delete(heap_t *h, heap_node_t *hn)
     if (h->datum_delete) {
       h->datum_delete(hn->datum);
     }
-    free(hn);
     hn = next;
   }
 }
 
 void heap_delete(heap_t *h)
 {
-  if (h->min) {
+  if (h->min && h->datum_delete) {
     heap_node_delete(h, h->min);
   }
+  node_pool_delete(&h->nodes);
   h->min = NULL;
   h->size = 0;
   h->compare = NULL;
@@ -134,7 +151,7 @@ heap_node_t *heap_insert(heap_t *h, void *v)
 {
   heap_node_t *n;
 
-  assert((n = calloc(1, sizeof (*n))));
+  n = heap_node_alloc(h);
   n->datum = v;
 
   if (h->min) {
@@ -220,7 +237,7 @@ void *heap_remove_min(heap_t *h)
   if (h->min) {
     v = h->min->datum;
     if (h->size == 1) {
-      free(h->min);
+      heap_node_free(h, h->min);
       h->min = NULL;
     } else {
       if ((n = h->min->child)) {
@@ -234,7 +251,7 @@ void *heap_remove_min(heap_t *h)
       n = h->min;
       remove_heap_node_from_list(n);
       h->min = n->next;
-      free(n);
+      heap_node_free(h, n);
 
       heap_consolidate(h);
     }
@@ -247,11 +264,16 @@ void *heap_remove_min(heap_t *h)
 
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
 {
+  node_pool_t nodes;
+
   if (h1->compare != h2->compare ||
       h1->datum_delete != h2->datum_delete) {
     return 1;
   }
 
+  /* h takes over the nodes of both, so it needs both pools */
+  node_pool_merge(&nodes, &h1->nodes, &h2->nodes);
+
   h->compare = h1->compare;
   h->datum_delete = h1->datum_delete;
 
@@ -265,11 +287,13 @@ int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
     h->min = ((h->compare(h1->min->datum, h2->min->datum) < 0) ?
               h1->min                                          :
               h2->min);
+    h->size = h1->size + h2->size;
     splice_heap_node_lists(h1->min, h2->min);
   }
 
   memset(h1, 0, sizeof (*h1));
   memset(h2, 0, sizeof (*h2));
+  h->nodes = nodes;
 
   return 0;
 }
@@ -7,14 +7,20 @@ extern "C" {
 
 # include <stdint.h>
 
+# include "node_pool.h"
+
 struct heap_node;
 typedef struct heap_node heap_node_t;
 
+/* Nodes come from a pool owned by the heap, so once a heap has grown *
+ * to its working size, inserts and removals don't allocate.          *
+ * heap_delete() releases the pool.                                   */
 typedef struct heap {
   heap_node_t *min;
   uint32_t size;
   int32_t (*compare)(const void *key, const void *with);
   void (*datum_delete)(void *);
+  node_pool_t nodes;
 } heap_t;
 
 void heap_init(heap_t *h,
@@ -11,6 +11,7 @@
 #include "character.h"
 #include "poke327.h"
 #include "db_parse.h"
+#include "pokemon.h"
 using namespace std;
 typedef struct io_message {
   /* Will print " --more-- " at end of line when another message follows. *
@@ -21,6 +22,134 @@ typedef struct io_message {
 
 static io_message_t *io_head, *io_tail;
 
+/* A session log is the seed followed by every input the game read, in *
+ * order.  Each input is one byte if it's in [0, 254], else 0xff and    *
+ * four bytes, little endian.  Replaying feeds the logged inputs back   *
+ * in place of the keyboard, so the same seed takes the same path.      */
+#define IO_LOG_MAGIC   "P327"
+#define IO_LOG_VERSION 1
+#define IO_LOG_LONG    0xff
+
+typedef enum io_log_mode {
+  io_log_none,
+  io_log_record,
+  io_log_replay
+} io_log_mode_t;
+
+static FILE *io_log;
+static io_log_mode_t io_log_mode;
+
+static void io_log_put(int32_t v)
+{
+  uint32_t u = v;
+
+  if (v >= 0 && v < IO_LOG_LONG) {
+    putc(v, io_log);
+  } else {
+    putc(IO_LOG_LONG, io_log);
+    putc(u & 0xff, io_log);
+    putc((u >> 8) & 0xff, io_log);
+    putc((u >> 16) & 0xff, io_log);
+    putc((u >> 24) & 0xff, io_log);
+  }
+  // Keep the log good up to the last key if the game dies
+  fflush(io_log);
+}
+
+static int32_t io_log_get()
+{
+  int c, i;
+  uint32_t u;
+
+  if ((c = getc(io_log)) == EOF) {
+    end_replay();
+  }
+  if (c != IO_LOG_LONG) {
+    return c;
+  }
+  for (u = i = 0; i < 4; i++) {
+    if ((c = getc(io_log)) == EOF) {
+      end_replay();
+    }
+    u |= (uint32_t) c << (i * 8);
+  }
+
+  return (int32_t) u;
+}
+
+int io_record_start(const char *path, uint32_t seed)
+{
+  if (!(io_log = fopen(path, "wb"))) {
+    perror(path);
+    return 1;
+  }
+  fwrite(IO_LOG_MAGIC, 1, 4, io_log);
+  putc(IO_LOG_VERSION, io_log);
+  putc(seed & 0xff, io_log);
+  putc((seed >> 8) & 0xff, io_log);
+  putc((seed >> 16) & 0xff, io_log);
+  putc((seed >> 24) & 0xff, io_log);
+  fflush(io_log);
+  io_log_mode = io_log_record;
+
+  return 0;
+}
+
+int io_replay_start(const char *path, uint32_t *seed)
+{
+  unsigned char h[9];
+
+  if (!(io_log = fopen(path, "rb"))) {
+    perror(path);
+    return 1;
+  }
+  if (fread(h, 1, sizeof (h), io_log) != sizeof (h) ||
+      memcmp(h, IO_LOG_MAGIC, 4) || h[4] != IO_LOG_VERSION) {
+    fprintf(stderr, "%s: not a version %d session log\n",
+            path, IO_LOG_VERSION);
+    fclose(io_log);
+    io_log = NULL;
+    return 1;
+  }
+  *seed = h[5] | h[6] << 8 | h[7] << 16 | (uint32_t) h[8] << 24;
+  io_log_mode = io_log_replay;
+
+  return 0;
+}
+
+/* All keyboard input goes through here so that it can be logged */
+int io_getch()
+{
+  int key;
+
+  if (io_log_mode == io_log_replay) {
+    return io_log_get();
+  }
+  key = getch();
+  if (io_log_mode == io_log_record) {
+    io_log_put(key);
+  }
+
+  return key;
+}
+
+/* Reads an integer typed at (y, x); 0 if there isn't one */
+static int io_scanw_int(int y, int x)
+{
+  int v;
+
+  if (io_log_mode == io_log_replay) {
+    return io_log_get();
+  }
+  v = 0;
+  mvscanw(y, x, "%d", &v);
+  if (io_log_mode == io_log_record) {
+    io_log_put(v);
+  }
+
+  return v;
+}
+
 void io_init_terminal(void)
 {
   initscr();
@@ -42,6 +171,11 @@ void io_reset_terminal(void)
 {
   endwin();
 
+  if (io_log) {
+    fclose(io_log);
+    io_log = NULL;
+  }
+
   while (io_head) {
     io_tail = io_head;
     io_head = io_head->next;
@@ -89,7 +223,7 @@ static void io_print_message_queue(uint32_t y, uint32_t x)
       mvprintw(y, x + 70, "%10s", " --more-- ");
       attroff(COLOR_PAIR(COLOR_CYAN));
       refresh();
-      getch();
+      io_getch();
     }
     free(io_tail);
   }
@@ -151,7 +285,7 @@ void io_display()
       if (world.cur_map->cmap[y][x]) {
         mvaddch(y + 1, x, world.cur_map->cmap[y][x]->symbol);
       } else {
-        switch (world.cur_map->map[y][x]) {
+        switch (world.cur_map->terrain(x, y)) {
         case ter_boulder:
         case ter_mountain:
           attron(COLOR_PAIR(COLOR_MAGENTA));
@@ -241,8 +375,9 @@ uint32_t io_teleport_pc(pair_t dest)
     dest[dim_x] = rand_range(1, MAP_X - 2);
     dest[dim_y] = rand_range(1, MAP_Y - 2);
   } while (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]                  ||
-           move_cost[char_pc][world.cur_map->map[dest[dim_y]]
-                                                [dest[dim_x]]] == INT_MAX ||
+           move_cost[char_pc][world.cur_map->terrain(dest[dim_x],
+                                                     dest[dim_y])] == INT_MAX ||
+           world.rival_dist[dest[dim_y]][dest[dim_x]] == INT_MAX             ||
            world.rival_dist[dest[dim_y]][dest[dim_x]] < 0);
 
   return 0;
@@ -259,7 +394,7 @@ static void io_scroll_trainer_list(char (*s)[40], uint32_t count)
     for (i = 0; i < 13; i++) {
       mvprintw(i + 6, 19, " %-40s ", s[i + offset]);
     }
-    switch (getch()) {
+    switch (io_getch()) {
     case KEY_UP:
       if (offset) {
         offset--;
@@ -311,7 +446,7 @@ static void io_list_trainers_display(Npc **c,
   if (count <= 13) {
     mvprintw(count + 6, 19, " %-40s ", "");
     mvprintw(count + 7, 19, " %-40s ", "Hit escape to continue.");
-    while (getch() != 27 /* escape */)
+    while (io_getch() != 27 /* escape */)
       ;
   } else {
     mvprintw(19, 19, " %-40s ", "");
@@ -362,7 +497,7 @@ void io_pokemart()
 
   wrefresh(pokemart);
   char c;
-  while((c = getch()) != 27){
+  while((c = io_getch()) != 27){
     wrefresh(pokemart);
     switch (c)
     {
@@ -403,7 +538,7 @@ void io_pokemart()
 }
 void io_save_pokemon()
 {
-  int pokeNum = getch() - '0';
+  int pokeNum = io_getch() - '0';
   if(pokeNum <= world.pc.inventory.size())
   {
     world.storage.push_back(world.pc.inventory.at(pokeNum - 1));
@@ -414,7 +549,7 @@ void io_save_pokemon()
 }
 void io_load_pokemon()
 {
-  int pokeNum = getch() - '0';
+  int pokeNum = io_getch() - '0';
   if(world.pc.inventory.size() == 6)
   {
     mvprintw(0,0,"You can't have more than 6 Pokemon!");
@@ -442,7 +577,7 @@ void io_pokemon_center()
   }
   wrefresh(pokemon_center);
   char p;
-  while(( p = getch()) != 27){
+  while(( p = io_getch()) != 27){
 
     switch(p){
       case 's':
@@ -480,178 +615,6 @@ void io_pokemon_center()
   }
   endwin();
 }
-Pokemon new_pokemon()
-{
-  Pokemon p;
-  int level;
-  int randPokemon = rand()%898+1;
-  int p_id = pokemon[randPokemon].id;
-  //find the manhatan distance between the
-  int x = abs(world.cur_idx[dim_x] - (int)(WORLD_SIZE / 2));
-  int y = abs(world.cur_idx[dim_y] - (int)(WORLD_SIZE / 2));
-  int distance = x + y;
-  if (distance <= 200) {
-      if(distance > 1)
-      {
-        level = rand()%(distance/2) + 1;
-      }
-      else
-      {
-        level = 1;
-      }
-  } else {
-    level = rand()%((distance - 200) / 2)+1;
-  }
-  p.level = level;
-  strcpy(p.identifier,pokemon[randPokemon].identifier);
-  bool is_shiny = false;
-  if(rand()%8192 == 0)
-  {
-    is_shiny = true;
-  }
-  //These are the iv stats
-  int health = rand()%16;
-  int attack = rand()%16;
-  int defense = rand()%16;
-  int speed = rand()%16;
-  int specialAttack = rand()%16;
-  int specialDefense = rand()%16;
-
-   if(is_shiny)
-  {
-    health = 10;
-    attack = 10;
-    defense = 10;
-    speed = 10;
-    specialAttack = 10;
-    specialDefense = 10;
-  }
-  int hp_base_stat;
-  int attack_base_stat;
-  int defense_base_stat;
-  int speed_base_stat;
-  int specialAttack_base_stat;
-  int specialDefense_base_stat;
-   for(int i = 0; i < 6552; i++)
-  {
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 1)
-    {
-      hp_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 2)
-    {
-      attack_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 3)
-    {
-      defense_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 4)
-    {
-      speed_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 5)
-    {
-      specialAttack_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 6)
-    {
-      specialDefense_base_stat = pokemon_stats[i].base_stat;
-    }
-  }
-
-   for(int i = 0; i < 1676; i++){
-    if(pokemon_types[i].pokemon_id == p_id && pokemon_types[i].slot == 1)
-    {
-      p.atk_id[0] = pokemon_types[i].type_id;
-    }
-    if(pokemon_types[i].pokemon_id == p_id && pokemon_types[i].slot == 2)
-    {
-      p.atk_id[1] = pokemon_types[i].type_id;
-    }
-  }
-
-  for(int i = 0; i < 899; i++){
-    if(species[i].id == p_id)
-    {
-      p.capture_rate = species[i].capture_rate;
-    }
-  }
-
-  p.base_speed = speed_base_stat;
-  p.hp = ((((hp_base_stat+health)*2)*level)/100)+level + 10;
-  p.default_hp = p.hp;
-  p.atk= ((((attack_base_stat+attack)*2)*level)/100) + 5;
-  p.def = ((((defense_base_stat+defense)*2)*level)/100) + 5;
-  p.spd = ((((speed_base_stat+speed)*2)*level)/100) + 5;
-  p.spa = ((((specialAttack_base_stat+specialAttack)*2)*level)/100) + 5;
-  p.sd = ((((specialDefense_base_stat+specialDefense)*2)*level)/100) + 5;
-  int move_id[1];
-  vector<int> viable_moves;
-  for (int i = 0; i < 528238; i++) {
-    if(pokemon_moves[i].pokemon_id == p_id && pokemon_moves[i].pokemon_move_method_id == 1 && pokemon_moves[i].level <= level)
-    {
-        viable_moves.push_back(pokemon_moves[i].move_id);
-    }
-  }
-  int size = viable_moves.size();
-  move_id[0] = viable_moves.at(rand()%size);
-
-  move_id[1] = viable_moves.at(rand()%size);
-  //check if move_id[0] is equal to move_id[1]
-  if(move_id[0] == move_id[1])
-  {
-    //if so, find a new move_id[1]
-    move_id[1] = viable_moves.at(rand()%size);
-  }
-
-
-  for(int i = 1; i < 845; i++)
-  {
-    if(moves[i].id == move_id[0])
-    {
-      p.power[0] = moves[i].power;
-      p.accuracy[0] = moves[i].accuracy;
-      p.move_priority[0] = moves[i].priority;
-      p.type_id = moves[i].type_id;
-      strcpy(p.move1, moves[i].identifier);
-    }
-    if(moves[i].id == move_id[1])
-    {
-      p.power[1] = moves[i].power;
-      if(p.power[1] == 0 || p.power[1] == -1){
-        p.power[1] = rand()%100;
-      }
-      p.accuracy[1] = moves[i].accuracy;
-      p.move_priority[1] = moves[i].priority;
-      strcpy(p.move2, moves[i].identifier);
-    }
-  }
-
-  if(p.power[1] == 0 || p.power[1] == -1){
-    p.power[1] = rand()%100;
-  }
-  if(p.power[0] == 0 || p.power[0] == -1){
-    p.power[0] = rand()%100;
-  }
-  pokemon[randPokemon].level = level;
-  char gender[10];
-  int gen = rand()%2;
-  if(gen == 0)
-  {
-     strcpy(p.gender,"Male");
-  }else{
-    strcpy(p.gender,"Female");
-  }
-  char shiny[5];
-  if(is_shiny)
-  {
-    strcpy(shiny,"Yes");
-  }else{
-    strcpy(shiny,"No");
-  }
-  return p;
-}
 Pokemon selectPokemon(){
 Pokemon null;
 null.hp = 999;
@@ -682,12 +645,12 @@ int faint_count = 0;
 
   }
 
-  char choice = getch();
+  char choice = io_getch();
   int choice_int = choice - '0';
   while(choice_int-1 > world.pc.inventory.size()- 1||world.pc.inventory.at(choice_int-1).hp == 0)
   {
     mvprintw(12,19,"Not in bag,enter the number you want to use or the pokemon is sleeping");
-    choice_int = getch() - '0';
+    choice_int = io_getch() - '0';
   }
   Pokemon p = world.pc.inventory.at(choice_int-1);
   world.pc.inventory.erase(world.pc.inventory.begin()+(choice_int-1));
@@ -708,20 +671,14 @@ void escape(WINDOW *pokemon_window,Pokemon fighter, Pokemon wild, int attmpt)
               wrefresh(pokemon_window);
           }
 }
-double type(Pokemon a, Pokemon b,int a_move,int b_move){
- double type = 100.0;
- for(int i = 0; i < 325; i++){
-   if(a.atk_id[a_move] == type_efficacy[i].damage_type_id){
-
-     for(int j = 0; j < 325; j++){
-       if(b.atk_id[b_move] == type_efficacy[j].target_type_id){
-         type = type_efficacy[i].damage_factor;
-       }
-     }
-   }
- }
+/* Effectiveness of a's move a_move against b, counting both of b's types */
+static inline double type(const Pokemon &a, const Pokemon &b,
+                          int a_move, int b_move)
+{
+  UNUSED(b_move);
 
-  return type/100;
+  return (type_damage_factor(a.move_type[a_move], b.atk_id[0], b.atk_id[1]) /
+          100.0);
 }
 
 int hitDamage(Pokemon atk,Pokemon def,int move,int d_move)
@@ -754,7 +711,8 @@ int hitDamage(Pokemon atk,Pokemon def,int move,int d_move)
   int damage;
   //int damage =(int) (((2*atk.level/5+2)*(atk.power[move]) *(atk.atk/def.def))/50 + 2)*critical*random*stab;
   if(rand()%100 < atk.accuracy[move]){
-   damage = (int) ((((((2*atk.level)/5)+2) * atk.power[move]*(atk.atk/atk.def))/50)+2)*critical*random*stab;
+   damage = (int) ((((((2*atk.level)/5)+2) * atk.power[move]*(atk.atk/atk.def))/50)+2)*critical*random*stab*
+            type(atk, def, move, d_move);
   }else{
     damage = 0;
   }
@@ -799,10 +757,19 @@ void io_battle(Character *aggressor, Character *defender)
     npc = dynamic_cast<Npc *>(defender);
 
   }
+  if (world.headless) {
+    // No one to fight it out; the PC always wins
+    npc->defeated = 1;
+    if (npc->ctype == char_hiker || npc->ctype == char_rival) {
+      npc->mtype = move_wander;
+    }
+    return;
+  }
 //there is a 60% probability that the trainer will get an (n+1)th Pokemon, up to a maximum of 6 Pokemons
   if(rand()%100 < 60 && npc->inventory.size() < 6)
   {
-    npc->inventory.push_back(new_pokemon());
+    npc->inventory.resize(npc->inventory.size() + 1);
+    make_pokemon(&npc->inventory.back(), NULL);
   }
   int tPokemon_size = npc->inventory.size();
   WINDOW *pokemon_battle = newwin(12,52,6,18);
@@ -818,7 +785,7 @@ void io_battle(Character *aggressor, Character *defender)
     //wborder(pokemon_battle, '|', '|', '-', '-', '+', '+', '+', '+');
     mvprintw(7, 19, "Trainer chose %s!", tPokemon.identifier);
     mvprintw(8, 19, "hit space to continue");
-    while((getch()) != 32)
+    while((io_getch()) != 32)
     {
 
     }
@@ -845,7 +812,7 @@ void io_battle(Character *aggressor, Character *defender)
     mvprintw(13, 19, "> %s", f_moves[1]);
     wrefresh(pokemon_battle);
     char opt;
-    while((opt = getch()) != 27)
+    while((opt = io_getch()) != 27)
     {
 
         wrefresh(pokemon_battle);
@@ -929,7 +896,7 @@ void io_battle(Character *aggressor, Character *defender)
               if (npc->ctype == char_hiker || npc->ctype == char_rival) {
                 npc->mtype = move_wander;
             }
-              while((getch()) != 32)
+              while((io_getch()) != 32)
               {
 
               }
@@ -954,7 +921,7 @@ void io_battle(Character *aggressor, Character *defender)
                 clear();
                 mvprintw(14,19,"All your pokemon are asleep");
                 mvprintw(15,19,"You lost, press space to close");
-                while((getch()) != 32)
+                while((io_getch()) != 32)
                 {
 
                 }
@@ -996,7 +963,7 @@ void io_battle(Character *aggressor, Character *defender)
                 if (npc->ctype == char_hiker || npc->ctype == char_rival) {
                  npc->mtype = move_wander;
                }
-                while((getch()) != 32)
+                while((io_getch()) != 32)
                 {
 
                 }
@@ -1041,7 +1008,7 @@ void io_battle(Character *aggressor, Character *defender)
                 if (npc->ctype == char_hiker || npc->ctype == char_rival) {
                     npc->mtype = move_wander;
                 }
-                while((getch()) != 32)
+                while((io_getch()) != 32)
                 {
 
                 }
@@ -1066,7 +1033,7 @@ void io_battle(Character *aggressor, Character *defender)
     }
 
      wrefresh(pokemon_battle);
-    while((getch()) != 27)
+    while((io_getch()) != 27)
     {
 
     }
@@ -1076,7 +1043,8 @@ void io_battle(Character *aggressor, Character *defender)
 
 //this function will compare the speed of two pokemon and return the faster one
 void pokemon_wild(){
-    Pokemon wild = new_pokemon();
+    Pokemon wild;
+    make_pokemon(&wild, NULL);
     WINDOW *pokemon_window = newwin(12,52,6,18);
    wborder(pokemon_window, '|', '|', '-', '-', '+', '+', '+', '+');
     mvprintw(6, 19, "A wild %s appeared!", wild.identifier);
@@ -1091,7 +1059,7 @@ void pokemon_wild(){
 
 
     wrefresh(pokemon_window);
-    while((getch()) != 'm')
+    while((io_getch()) != 'm')
     {
 
     }
@@ -1120,7 +1088,7 @@ void pokemon_wild(){
     wrefresh(pokemon_window);
     char opt;
 
-    while((opt = getch()) != 27)
+    while((opt = io_getch()) != 27)
     {
 
         wrefresh(pokemon_window);
@@ -1159,7 +1127,7 @@ void pokemon_wild(){
         {
           op_action = 2;
           wild_ai(pokemon_window,wild,op_action,w_moves,0);
-          while((getch()) != 32)
+          while((io_getch()) != 32)
           {
 
           }
@@ -1167,7 +1135,7 @@ void pokemon_wild(){
           clear();
           mvprintw(18,19,"%s ran away press space to continue",wild.identifier);
           wrefresh(pokemon_window);
-          while((getch()) != 32)
+          while((io_getch()) != 32)
           {
 
           }
@@ -1215,7 +1183,7 @@ void pokemon_wild(){
                 }
                 wrefresh(pokemon_window);
 
-                while((getch()) != 32)
+                while((io_getch()) != 32)
                 {
 
                 }
@@ -1238,7 +1206,7 @@ void pokemon_wild(){
               mvprintw(14, 19, "%s fainted",fighter.identifier);
               mvprintw(15,19,"You lost press space to close");
               world.pc.inventory.push_back(fighter);
-              while((getch()) != 32)
+              while((io_getch()) != 32)
               {
 
               }
@@ -1264,7 +1232,7 @@ void pokemon_wild(){
               mvprintw(15,19,"You lost press space to close");
               world.pc.inventory.push_back(fighter);
               wrefresh(pokemon_window);
-              while((getch()) != 32)
+              while((io_getch()) != 32)
               {
 
               }
@@ -1306,7 +1274,7 @@ void pokemon_wild(){
               }
 
               wrefresh(pokemon_window);
-              while((getch()) != 32)
+              while((io_getch()) != 32)
               {
 
               }
@@ -1338,9 +1306,13 @@ void choose_pokemon()
   world.pc.potions = 6;
   for(int i = 0; i < 3; i++)
   {
-    Pokemon p1 = new_pokemon();
-    Pokemon p2 = new_pokemon();
-    Pokemon p3 = new_pokemon();
+    Pokemon starters[3];
+    make_pokemon(&starters[0], NULL);
+    make_pokemon(&starters[1], NULL);
+    make_pokemon(&starters[2], NULL);
+    Pokemon &p1 = starters[0];
+    Pokemon &p2 = starters[1];
+    Pokemon &p3 = starters[2];
     //print each pokemon stats
     mvprintw(7, 19, "1. %s 2. %s 3. %s",p1.identifier,p2.identifier,p3.identifier);
     mvprintw(8, 19, "HP: %2d | %d | %d",p1.hp,p2.hp,p3.hp);
@@ -1350,7 +1322,7 @@ void choose_pokemon()
     mvprintw(12, 19, "Special Attack: %d | %d | %d",p1.spa,p2.spa,p3.spa);
     mvprintw(13, 19, "Special Defense: %d | %d | %d",p1.sd,p2.sd,p3.sd);
     wrefresh(choose_pokemon_window);
-    int choice = getch();
+    int choice = io_getch();
 
     switch(choice)
     {
@@ -1410,18 +1382,18 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
     dest[dim_x]++;
     break;
   case '>':
-    if (world.cur_map->map[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ==
+    if (world.cur_map->terrain(world.pc.pos[dim_x], world.pc.pos[dim_y]) ==
         ter_mart) {
       io_pokemart();
     }
-    if (world.cur_map->map[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ==
+    if (world.cur_map->terrain(world.pc.pos[dim_x], world.pc.pos[dim_y]) ==
         ter_center) {
       io_pokemon_center();
     }
     break;
   }
 
-  if ((world.cur_map->map[dest[dim_y]][dest[dim_x]] == ter_exit) &&
+  if ((world.cur_map->terrain(dest[dim_x], dest[dim_y]) == ter_exit) &&
       (input == 1 || input == 3 || input == 7 || input == 9)) {
     // Exiting diagonally leads to complicated entry into the new map
     // in order to avoid INT_MAX move costs in the destination.
@@ -1429,7 +1401,7 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
     return 1;
   }
 
-  if(world.cur_map->map[dest[dim_y]][dest[dim_x]] == ter_grass){
+  if(world.cur_map->terrain(dest[dim_x], dest[dim_y]) == ter_grass){
       bool chance = (rand()%100) < 10;
       if(chance){
         pokemon_wild();
@@ -1458,7 +1430,7 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
     }
   }
 
-  if (move_cost[char_pc][world.cur_map->map[dest[dim_y]][dest[dim_x]]] ==
+  if (move_cost[char_pc][world.cur_map->terrain(dest[dim_x], dest[dim_y])] ==
       INT_MAX) {
     return 1;
   }
@@ -1476,10 +1448,10 @@ void io_teleport_world(pair_t dest)
   refresh();
   echo();
   curs_set(1);
-  mvscanw(0, 21, "%d", &x);
+  x = io_scanw_int(0, 21);
   mvprintw(0, 0, "Enter y [-200, 200]:          ");
   refresh();
-  mvscanw(0, 21, "%d", &y);
+  y = io_scanw_int(0, 21);
   refresh();
   noecho();
   curs_set(0);
@@ -1508,7 +1480,7 @@ void io_teleport_world(pair_t dest)
 }
 void revivePokemon()
 {
-  int pokeNum = getch() - '0';
+  int pokeNum = io_getch() - '0';
   if(pokeNum <= world.pc.inventory.size() && world.pc.inventory.at(pokeNum - 1).hp == 0 && world.pc.revives > 0)
   {
     world.pc.revives = world.pc.revives - 1;
@@ -1517,7 +1489,7 @@ void revivePokemon()
 
 }
 void pokemonPotion(){
-  int pokeNum = getch() - '0';
+  int pokeNum = io_getch() - '0';
   if((pokeNum <= world.pc.inventory.size())&&world.pc.inventory.at(pokeNum -1).hp != 0 && (world.pc.inventory.at(pokeNum - 1).hp < world.pc.inventory.at(pokeNum - 1).default_hp) && world.pc.potions > 0){
     world.pc.inventory.at(pokeNum - 1).hp += 20;
     if(world.pc.inventory.at(pokeNum - 1).hp > world.pc.inventory.at(pokeNum - 1).default_hp)
@@ -1533,7 +1505,7 @@ void printBag()
   //print all pokemon in the players inventory
   WINDOW *player_inventory = newwin(12,52,6,18);
   int opt;
-  while((opt = getch()) != 27)
+  while((opt = io_getch()) != 27)
   {
     mvprintw(6,19,"PokeBucks: %d |Pokemon Balls: %d |Pokemon Potion: %d |Revives: %d",world.pc.pokebux,world.pc.pokeballs,world.pc.potions,world.pc.revives);
     for(int i = 0; i < world.pc.inventory.size(); i++){
@@ -1576,7 +1548,7 @@ void io_handle_input(pair_t dest)
   int key;
 
   do {
-    switch (key = getch()) {
+    switch (key = io_getch()) {
     case '7':
     case 'y':
     case KEY_HOME:
@@ -4,6 +4,9 @@
 class Character;
 typedef int16_t pair_t[2];
 
+int io_record_start(const char *path, uint32_t seed);
+int io_replay_start(const char *path, uint32_t *seed);
+int io_getch(void);
 void io_init_terminal(void);
 void io_reset_terminal(void);
 void io_display(void);
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "node_pool.h"
+
+/* Each slab is twice the size of the last, up to NODE_SLAB_MAX nodes */
+#define NODE_SLAB_MIN 16
+#define NODE_SLAB_MAX 4096
+
+struct node_slab {
+  struct node_slab *next;
+  uint32_t num_nodes;
+  max_align_t node[];
+};
+
+void node_pool_init(node_pool_t *p, uint32_t node_size)
+{
+  assert(node_size >= sizeof (void *));
+
+  p->free_nodes = NULL;
+  p->slabs = NULL;
+  p->node_size = node_size;
+}
+
+void node_pool_delete(node_pool_t *p)
+{
+  struct node_slab *s;
+
+  while ((s = p->slabs)) {
+    p->slabs = s->next;
+    free(s);
+  }
+  p->free_nodes = NULL;
+}
+
+void node_pool_grow(node_pool_t *p)
+{
+  struct node_slab *s;
+  uint32_t i, num_nodes;
+  char *n;
+
+  num_nodes = p->slabs ? p->slabs->num_nodes * 2 : NODE_SLAB_MIN;
+  if (num_nodes > NODE_SLAB_MAX) {
+    num_nodes = NODE_SLAB_MAX;
+  }
+  s = malloc(sizeof (*s) + (size_t) num_nodes * p->node_size);
+  assert(s);
+  s->num_nodes = num_nodes;
+  s->next = p->slabs;
+  p->slabs = s;
+  for (i = 0, n = (char *) s->node; i < num_nodes; i++, n += p->node_size) {
+    node_pool_free(p, n);
+  }
+}
+
+/* p takes over the slabs and free nodes of p1 and p2, which are left *
+ * empty.  p may be either of them.                                   */
+void node_pool_merge(node_pool_t *p, node_pool_t *p1, node_pool_t *p2)
+{
+  struct node_slab *s, *slabs;
+  void *n, *next, *free_nodes;
+
+  assert(p1->node_size == p2->node_size);
+
+  if ((slabs = p1->slabs)) {
+    for (s = slabs; s->next; s = s->next)
+      ;
+    s->next = p2->slabs;
+  } else {
+    slabs = p2->slabs;
+  }
+  if ((free_nodes = p1->free_nodes)) {
+    for (n = free_nodes; memcpy(&next, n, sizeof (next)), next; n = next)
+      ;
+    memcpy(n, &p2->free_nodes, sizeof (p2->free_nodes));
+  } else {
+    free_nodes = p2->free_nodes;
+  }
+
+  p->node_size = p1->node_size;
+  p1->slabs = p2->slabs = NULL;
+  p1->free_nodes = p2->free_nodes = NULL;
+  p->slabs = slabs;
+  p->free_nodes = free_nodes;
+}
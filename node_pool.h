@@ -0,0 +1,53 @@
+#ifndef NODE_POOL_H
+# define NODE_POOL_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+# include <stdint.h>
+# include <string.h>
+
+struct node_slab;
+
+/* Fixed-size nodes for the heaps.  Nodes are carved out of slabs owned *
+ * by the pool and recycled through a free list, so once a pool has     *
+ * grown to its working size, allocating and freeing don't call malloc. *
+ * A free node's first pointer-sized bytes hold the free list link, so  *
+ * nodes must be at least that big.  node_pool_delete() releases the    *
+ * slabs, and every node with them, in use or not.                      */
+typedef struct node_pool {
+  void *free_nodes;
+  struct node_slab *slabs;
+  uint32_t node_size;
+} node_pool_t;
+
+void node_pool_init(node_pool_t *p, uint32_t node_size);
+void node_pool_delete(node_pool_t *p);
+void node_pool_grow(node_pool_t *p);
+void node_pool_merge(node_pool_t *p, node_pool_t *p1, node_pool_t *p2);
+
+static inline void *node_pool_alloc(node_pool_t *p)
+{
+  void *n;
+
+  if (!p->free_nodes) {
+    node_pool_grow(p);
+  }
+  n = p->free_nodes;
+  memcpy(&p->free_nodes, n, sizeof (p->free_nodes));
+
+  return n;
+}
+
+static inline void node_pool_free(node_pool_t *p, void *n)
+{
+  memcpy(n, &p->free_nodes, sizeof (p->free_nodes));
+  p->free_nodes = n;
+}
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
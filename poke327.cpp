@@ -2,18 +2,29 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <limits.h>
 #include <sys/time.h>
+#include <time.h>
 #include <assert.h>
 #include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "heap.h"
 #include "poke327.h"
 #include "character.h"
 #include "io.h"
 #include "db_parse.h"
+#include "pokemon.h"
 
 typedef struct queue_node {
   int x, y;
@@ -22,6 +33,18 @@ typedef struct queue_node {
 
 World world;
 
+/* A map being generated.  Only the terrain and exits are kept.     *
+ * Generation draws only from the map's terrain stream, through     *
+ * gen_rand(), so it can run on any thread and in any order.        */
+typedef struct map_gen {
+  terrain_type_t map[MAP_Y][MAP_X];
+  uint8_t height[MAP_Y][MAP_X];
+  int8_t n, s, e, w;
+  map_rng_t rng;
+} map_gen_t;
+
+#define gen_rand(m) map_rand(&(m)->rng)
+
 pair_t all_dirs[8] = {
   { -1, -1 },
   { -1,  0 },
@@ -33,20 +56,27 @@ pair_t all_dirs[8] = {
   {  1,  1 },
 };
 
-static int32_t path_cmp(const void *key, const void *with) {
-  return ((path_t *) key)->cost - ((path_t *) with)->cost;
-}
+struct path_order {
+  bool operator()(const path_t *a, const path_t *b) const
+  {
+    return a->cost < b->cost;
+  }
+};
+
+struct path_qpos {
+  uint32_t *operator()(path_t *p) const { return &p->qpos; }
+};
 
 static int32_t edge_penalty(int8_t x, int8_t y)
 {
   return (x == 1 || y == 1 || x == MAP_X - 2 || y == MAP_Y - 2) ? 2 : 1;
 }
 
-static void dijkstra_path(Map *m, pair_t from, pair_t to)
+static void dijkstra_path(map_gen_t *m, pair_t from, pair_t to)
 {
-  static path_t path[MAP_Y][MAP_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
+  static thread_local path_t path[MAP_Y][MAP_X], *p;
+  static thread_local uint32_t initialized = 0;
+  static thread_local pqueue<path_t *, path_order, path_qpos> h;
   int32_t x, y;
 
   if (!initialized) {
@@ -59,24 +89,25 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
     initialized = 1;
   }
 
+  /* Only the interior is queued; the border must read as not queued *
+   * so it's never relaxed.                                           */
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
       path[y][x].cost = INT_MAX;
+      path[y][x].qpos = PQUEUE_NOT_QUEUED;
     }
   }
 
   path[from[dim_y]][from[dim_x]].cost = 0;
 
-  heap_init(&h, path_cmp, NULL);
-
   for (y = 1; y < MAP_Y - 1; y++) {
     for (x = 1; x < MAP_X - 1; x++) {
-      path[y][x].hn = heap_insert(&h, &path[y][x]);
+      h.push(&path[y][x]);
     }
   }
 
-  while ((p = (path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
+  while (!h.empty()) {
+    p = h.pop();
 
     if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
       for (x = to[dim_x], y = to[dim_y];
@@ -85,11 +116,11 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
         mapxy(x, y) = ter_path;
         heightxy(x, y) = 0;
       }
-      heap_delete(&h);
+      h.clear();
       return;
     }
 
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
+    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].qpos != PQUEUE_NOT_QUEUED) &&
         (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1)))) {
@@ -98,10 +129,9 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1));
       path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
+      h.decrease_key(&path[p->pos[dim_y] - 1][p->pos[dim_x]    ]);
     }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
+    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].qpos != PQUEUE_NOT_QUEUED) &&
         (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y])))) {
@@ -110,10 +140,9 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y]));
       path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
+      h.decrease_key(&path[p->pos[dim_y]    ][p->pos[dim_x] - 1]);
     }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
+    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].qpos != PQUEUE_NOT_QUEUED) &&
         (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y])))) {
@@ -122,10 +151,9 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y]));
       path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
+      h.decrease_key(&path[p->pos[dim_y]    ][p->pos[dim_x] + 1]);
     }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
+    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].qpos != PQUEUE_NOT_QUEUED) &&
         (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1)))) {
@@ -134,13 +162,12 @@ static void dijkstra_path(Map *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1));
       path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
+      h.decrease_key(&path[p->pos[dim_y] + 1][p->pos[dim_x]    ]);
     }
   }
 }
 
-static int build_paths(Map *m)
+static int build_paths(map_gen_t *m)
 {
   pair_t from, to;
 
@@ -239,7 +266,7 @@ static int gaussian[5][5] = {
   {  1,  4,  7,  4,  1 }
 };
 
-static int smooth_height(Map *m)
+static int smooth_height(map_gen_t *m)
 {
   int32_t i, x, y;
   int32_t s, t, p, q;
@@ -252,8 +279,8 @@ static int smooth_height(Map *m)
   /* Seed with some values */
   for (i = 1; i < 255; i += 20) {
     do {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
+      x = gen_rand(m) % MAP_X;
+      y = gen_rand(m) % MAP_Y;
     } while (height[y][x]);
     height[y][x] = i;
     if (i == 1) {
@@ -396,11 +423,11 @@ static int smooth_height(Map *m)
   return 0;
 }
 
-static void find_building_location(Map *m, pair_t p)
+static void find_building_location(map_gen_t *m, pair_t p)
 {
   do {
-    p[dim_x] = rand() % (MAP_X - 5) + 3;
-    p[dim_y] = rand() % (MAP_Y - 10) + 5;
+    p[dim_x] = gen_rand(m) % (MAP_X - 5) + 3;
+    p[dim_y] = gen_rand(m) % (MAP_Y - 10) + 5;
 
     if ((((mapxy(p[dim_x] - 1, p[dim_y]    ) == ter_path)     &&
           (mapxy(p[dim_x] - 1, p[dim_y] + 1) == ter_path))    ||
@@ -427,7 +454,7 @@ static void find_building_location(Map *m, pair_t p)
   } while (1);
 }
 
-static int place_pokemart(Map *m)
+static int place_pokemart(map_gen_t *m)
 {
   pair_t p;
 
@@ -441,7 +468,7 @@ static int place_pokemart(Map *m)
   return 0;
 }
 
-static int place_center(Map *m)
+static int place_center(map_gen_t *m)
 {  pair_t p;
 
   find_building_location(m, p);
@@ -454,7 +481,7 @@ static int place_center(Map *m)
   return 0;
 }
 
-static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
+static int map_terrain(map_gen_t *m, int8_t n, int8_t s, int8_t e, int8_t w)
 {
   int32_t i, x, y;
   queue_node_t *head, *tail, *tmp;
@@ -463,10 +490,10 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   terrain_type_t type;
   int added_current = 0;
 
-  num_grass = rand() % 4 + 2;
-  num_clearing = rand() % 4 + 2;
-  num_mountain = rand() % 2 + 1;
-  num_forest = rand() % 2 + 1;
+  num_grass = gen_rand(m) % 4 + 2;
+  num_clearing = gen_rand(m) % 4 + 2;
+  num_mountain = gen_rand(m) % 2 + 1;
+  num_forest = gen_rand(m) % 2 + 1;
   num_total = num_grass + num_clearing + num_mountain + num_forest;
 
   memset(&m->map, 0, sizeof (m->map));
@@ -474,8 +501,8 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   /* Seed with some values */
   for (i = 0; i < num_total; i++) {
     do {
-      x = rand() % MAP_X;
-      y = rand() % MAP_Y;
+      x = gen_rand(m) % MAP_X;
+      y = gen_rand(m) % MAP_Y;
     } while (m->map[y][x]);
     if (i == 0) {
       type = ter_grass;
@@ -512,7 +539,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
     i = m->map[y][x];
 
     if (x - 1 >= 0 && !m->map[y][x - 1]) {
-      if ((rand() % 100) < 80) {
+      if ((gen_rand(m) % 100) < 80) {
         m->map[y][x - 1] = (terrain_type_t) i;
         tail->next = (queue_node_t *) malloc(sizeof (*tail));
         tail = tail->next;
@@ -531,7 +558,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
     }
 
     if (y - 1 >= 0 && !m->map[y - 1][x]) {
-      if ((rand() % 100) < 20) {
+      if ((gen_rand(m) % 100) < 20) {
         m->map[y - 1][x] = (terrain_type_t) i;
         tail->next = (queue_node_t *) malloc(sizeof (*tail));
         tail = tail->next;
@@ -550,7 +577,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
     }
 
     if (y + 1 < MAP_Y && !m->map[y + 1][x]) {
-      if ((rand() % 100) < 20) {
+      if ((gen_rand(m) % 100) < 20) {
         m->map[y + 1][x] = (terrain_type_t) i;
         tail->next = (queue_node_t *) malloc(sizeof (*tail));
         tail = tail->next;
@@ -569,7 +596,7 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
     }
 
     if (x + 1 < MAP_X && !m->map[y][x + 1]) {
-      if ((rand() % 100) < 80) {
+      if ((gen_rand(m) % 100) < 80) {
         m->map[y][x + 1] = (terrain_type_t) i;
         tail->next = (queue_node_t *) malloc(sizeof (*tail));
         tail = tail->next;
@@ -634,14 +661,14 @@ static int map_terrain(Map *m, int8_t n, int8_t s, int8_t e, int8_t w)
   return 0;
 }
 
-static int place_boulders(Map *m)
+static int place_boulders(map_gen_t *m)
 {
   int i;
   int x, y;
 
-  for (i = 0; i < MIN_BOULDERS || rand() % 100 < BOULDER_PROB; i++) {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
+  for (i = 0; i < MIN_BOULDERS || gen_rand(m) % 100 < BOULDER_PROB; i++) {
+    y = gen_rand(m) % (MAP_Y - 2) + 1;
+    x = gen_rand(m) % (MAP_X - 2) + 1;
     if (m->map[y][x] != ter_forest && m->map[y][x] != ter_path) {
       m->map[y][x] = ter_boulder;
     }
@@ -650,14 +677,14 @@ static int place_boulders(Map *m)
   return 0;
 }
 
-static int place_trees(Map *m)
+static int place_trees(map_gen_t *m)
 {
   int i;
   int x, y;
 
-  for (i = 0; i < MIN_TREES || rand() % 100 < TREE_PROB; i++) {
-    y = rand() % (MAP_Y - 2) + 1;
-    x = rand() % (MAP_X - 2) + 1;
+  for (i = 0; i < MIN_TREES || gen_rand(m) % 100 < TREE_PROB; i++) {
+    y = gen_rand(m) % (MAP_Y - 2) + 1;
+    x = gen_rand(m) % (MAP_X - 2) + 1;
     if (m->map[y][x] != ter_mountain && m->map[y][x] != ter_path) {
       m->map[y][x] = ter_tree;
     }
@@ -666,199 +693,18 @@ static int place_trees(Map *m)
   return 0;
 }
 
-void rand_pos(pair_t pos)
+void rand_pos(pair_t pos, map_rng_t *r)
 {
-  pos[dim_x] = (rand() % (MAP_X - 2)) + 1;
-  pos[dim_y] = (rand() % (MAP_Y - 2)) + 1;
+  pos[dim_x] = (map_rand(r) % (MAP_X - 2)) + 1;
+  pos[dim_y] = (map_rand(r) % (MAP_Y - 2)) + 1;
 }
-Pokemon generate_pokemon()
-{
-  Pokemon p;
-  int level;
-  int randPokemon = rand()%898+1;
-  int p_id = pokemon[randPokemon].id;
-  //find the manhatan distance between the
-  int x = abs(world.cur_idx[dim_x] - (int)(WORLD_SIZE / 2));
-  int y = abs(world.cur_idx[dim_y] - (int)(WORLD_SIZE / 2));
-  int distance = x + y;
-  if (distance <= 200) {
-      if(distance > 1)
-      {
-        level = rand()%(distance/2) + 1;
-      }
-      else
-      {
-        level = 1;
-      }
-  } else {
-    level = rand()%((distance - 200) / 2)+1;
-  }
-  p.level = level;
-  strcpy(p.identifier,pokemon[randPokemon].identifier);
-  bool is_shiny = false;
-  if(rand()%8192 == 0)
-  {
-    is_shiny = true;
-  }
-  //These are the iv stats
-  int health = rand()%16;
-  int attack = rand()%16;
-  int defense = rand()%16;
-  int speed = rand()%16;
-  int specialAttack = rand()%16;
-  int specialDefense = rand()%16;
-
-   if(is_shiny)
-  {
-    health = 10;
-    attack = 10;
-    defense = 10;
-    speed = 10;
-    specialAttack = 10;
-    specialDefense = 10;
-  }
-  int hp_base_stat;
-  int attack_base_stat;
-  int defense_base_stat;
-  int speed_base_stat;
-  int specialAttack_base_stat;
-  int specialDefense_base_stat;
-   for(int i = 0; i < 6552; i++)
-  {
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 1)
-    {
-      hp_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 2)
-    {
-      attack_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 3)
-    {
-      defense_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 4)
-    {
-      speed_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 5)
-    {
-      specialAttack_base_stat = pokemon_stats[i].base_stat;
-    }
-    if(pokemon_stats[i].pokemon_id == p_id && pokemon_stats[i].stat_id == 6)
-    {
-      specialDefense_base_stat = pokemon_stats[i].base_stat;
-    }
-  }
-
-
-  for(int i = 0; i < 1676; i++){
-    if(pokemon_types[i].pokemon_id == p_id && pokemon_types[i].slot == 1)
-    {
-      p.atk_id[0] = pokemon_types[i].type_id;
-    }
-    if(pokemon_types[i].pokemon_id == p_id && pokemon_types[i].slot == 2)
-    {
-      p.atk_id[1] = pokemon_types[i].type_id;
-    }
-  }
-
-  for(int i = 0; i < 899; i++){
-    if(species[i].id == p_id)
-    {
-      p.capture_rate = species[i].capture_rate;
-    }
-  }
-
-  p.base_speed = speed_base_stat;
-  p.hp = ((((hp_base_stat+health)*2)*level)/100)+level + 10;
-  p.default_hp = p.hp;
-  p.atk= ((((attack_base_stat+attack)*2)*level)/100) + 5;
-  p.def = ((((defense_base_stat+defense)*2)*level)/100) + 5;
-  p.spd = ((((speed_base_stat+speed)*2)*level)/100) + 5;
-  p.spa = ((((specialAttack_base_stat+specialAttack)*2)*level)/100) + 5;
-  p.sd = ((((specialDefense_base_stat+specialDefense)*2)*level)/100) + 5;
-  int move_id[1];
-  vector<int> viable_moves;
-  for (int i = 0; i < 528238; i++) {
-    if(pokemon_moves[i].pokemon_id == p_id && pokemon_moves[i].pokemon_move_method_id == 1 && pokemon_moves[i].level <= level)
-    {
-        viable_moves.push_back(pokemon_moves[i].move_id);
-    }
-  }
-
-
-  int size = viable_moves.size();
-  move_id[0] = viable_moves.at(rand()%size);
-
-  move_id[1] = viable_moves.at(rand()%size);
-  //check if move_id[0] is equal to move_id[1]
-  if(move_id[0] == move_id[1])
-  {
-    //if so, find a new move_id[1]
-    move_id[1] = viable_moves.at(rand()%size);
-  }
-
-
-  char move1[30];
-  char move2[30];
-  for(int i = 1; i < 835; i++)
-  {
-    if(moves[i].id == move_id[0])
-    {
-      p.type_id = moves[i].type_id;
-      p.power[0]= moves[i].power;
-      if(p.power[0] == 0 || p.power[0] == -1){
-        p.power[0] = rand()%100;
-      }
-      p.accuracy[0] = moves[i].accuracy;
-      p.move_priority[0]= moves[i].priority;
-      strcpy(p.move1, moves[i].identifier);
-    }
-    if(moves[i].id == move_id[1])
-    {
-      p.power[1]= moves[i].power;
-      if(p.power[1] == 0 || p.power[1] == -1){
-        p.power[1] = rand()%100;
-      }
-      p.accuracy[1] = moves[i].accuracy;
-      p.move_priority[1]= moves[i].priority;
-      strcpy(p.move2, moves[i].identifier);
-    }
-  }
-  if(p.power[1] == 0 || p.power[1] == -1){
-    p.power[1] = rand()%100;
-  }
-
-  if(p.power[0] == 0 || p.power[0] == -1){
-    p.power[0] = rand()%100;
-  }
-  pokemon[randPokemon].level = level;
-  char gender[10];
-  int gen = rand()%2;
-  if(gen == 0)
-  {
-     strcpy(p.gender,"Male");
-  }else{
-    strcpy(p.gender,"Female");
-  }
-  char shiny[5];
-  if(is_shiny)
-  {
-    strcpy(shiny,"Yes");
-  }else{
-    strcpy(shiny,"No");
-  }
-  return p;
-}
-
-void new_hiker()
+void new_hiker(map_rng_t *r, map_rng_t *pos_r)
 {
   pair_t pos;
   Npc *c;
 
   do {
-    rand_pos(pos);
+    rand_pos(pos, pos_r);
   } while (world.hiker_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
            world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
            pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4            ||
@@ -874,19 +720,20 @@ void new_hiker()
   c->defeated = 0;
   c->symbol = 'h';
   c->next_turn = 0;
-  c->inventory.push_back(generate_pokemon());
-  heap_insert(&world.cur_map->turn, c);
+  c->inventory.resize(1);
+  make_pokemon(&c->inventory[0], r);
+  world.cur_map->turn.push(c);
 
   //  printf("Hiker at %d,%d\n", pos[dim_x], pos[dim_y]);
 }
 
-void new_rival()
+void new_rival(map_rng_t *r, map_rng_t *pos_r)
 {
   pair_t pos;
   Npc *c;
 
   do {
-    rand_pos(pos);
+    rand_pos(pos, pos_r);
   } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
            world.rival_dist[pos[dim_y]][pos[dim_x]] < 0        ||
            world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
@@ -903,17 +750,19 @@ void new_rival()
   c->defeated = 0;
   c->symbol = 'r';
   c->next_turn = 0;
-  c->inventory.push_back(generate_pokemon());
-  heap_insert(&world.cur_map->turn, c);
+  c->inventory.resize(1);
+  make_pokemon(&c->inventory[0], r);
+  world.cur_map->turn.push(c);
 }
 
-void new_char_other()
+void new_char_other(map_rng_t *r, map_rng_t *pos_r)
 {
   pair_t pos;
   Npc *c;
+  int i;
 
   do {
-    rand_pos(pos);
+    rand_pos(pos, pos_r);
   } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
            world.rival_dist[pos[dim_y]][pos[dim_x]] < 0        ||
            world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
@@ -924,7 +773,7 @@ void new_char_other()
   c->pos[dim_y] = pos[dim_y];
   c->pos[dim_x] = pos[dim_x];
   c->ctype = char_other;
-  switch (rand() % 4) {
+  switch (map_rand(r) % 4) {
   case 0:
     c->mtype = move_pace;
     c->symbol = 'p';
@@ -942,36 +791,56 @@ void new_char_other()
     c->symbol = 'n';
     break;
   }
-  rand_dir(c->dir);
+  i = map_rand(r) & 0x7;
+  c->dir[dim_x] = all_dirs[i][dim_x];
+  c->dir[dim_y] = all_dirs[i][dim_y];
   c->defeated = 0;
   c->next_turn = 0;
   c->p_init = 0;
-  c->inventory.push_back(generate_pokemon());
-  heap_insert(&world.cur_map->turn, c);
+  c->inventory.resize(1);
+  make_pokemon(&c->inventory[0], r);
+  world.cur_map->turn.push(c);
 }
 
+/* Trainers draw from the map's own character stream, so who lives on *
+ * a map doesn't depend on what was generated before it.  Where they  *
+ * stand is drawn from a substream of the map's position stream, one  *
+ * per trainer.  Spots are redrawn until one is free and reachable,   *
+ * which depends on where the PC came in, so that can move a trainer  *
+ * but never changes who the trainers are or where the others stand. */
 void place_characters()
 {
+  map_rng_t r, pos, pos_r;
+  uint32_t slot;
+
+  map_rng_init(&r, world.cur_idx[dim_x], world.cur_idx[dim_y],
+               map_stream_characters);
+  map_rng_init(&pos, world.cur_idx[dim_x], world.cur_idx[dim_y],
+               map_stream_positions);
   world.cur_map->num_trainers = 2;
+  slot = 0;
 
   //Always place a hiker and a rival, then place a random number of others
-  new_hiker();
-  new_rival();
+  map_rng_split(&pos_r, &pos, slot++);
+  new_hiker(&r, &pos_r);
+  map_rng_split(&pos_r, &pos, slot++);
+  new_rival(&r, &pos_r);
   do {
+    map_rng_split(&pos_r, &pos, slot++);
     //higher probability of non- hikers and rivals
-    switch(rand() % 10) {
+    switch(map_rand(&r) % 10) {
     case 0:
-      new_hiker();
+      new_hiker(&r, &pos_r);
       break;
     case 1:
-     new_rival();
+     new_rival(&r, &pos_r);
       break;
     default:
-      new_char_other();
+      new_char_other(&r, &pos_r);
       break;
     }
   } while (++world.cur_map->num_trainers < MIN_TRAINERS ||
-           ((rand() % 100) < ADD_TRAINER_PROB));
+           ((map_rand(&r) % 100) < ADD_TRAINER_PROB));
 }
 
 void init_pc()
@@ -981,7 +850,7 @@ void init_pc()
   do {
     x = rand() % (MAP_X - 2) + 1;
     y = rand() % (MAP_Y - 2) + 1;
-  } while (world.cur_map->map[y][x] != ter_path);
+  } while (world.cur_map->terrain(x, y) != ter_path);
 
   world.pc.pos[dim_x] = x;
   world.pc.pos[dim_y] = y;
@@ -990,7 +859,7 @@ void init_pc()
   world.cur_map->cmap[y][x] = &world.pc;
   world.pc.next_turn = 0;
 
-  heap_insert(&world.cur_map->turn, &world.pc);
+  world.cur_map->turn.push(&world.pc);
 }
 
 void place_pc()
@@ -1009,87 +878,466 @@ void place_pc()
 
   world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
 
-  if ((c = (Character *) heap_peek_min(&world.cur_map->turn))) {
+  if (!world.cur_map->turn.empty()) {
+    c = world.cur_map->turn.top();
     world.pc.next_turn = c->next_turn;
   } else {
     world.pc.next_turn = 0;
   }
 }
 
-// New map expects cur_idx to refer to the index to be generated.  If that
-// map has already been generated then the only thing this does is set
-// cur_map.
-int new_map(int teleport)
+/* A paged-out map is a map_page_t, then an npc_page_t for each NPC in *
+ * turn order, each followed by its Pokemon.  The PC is never on a map *
+ * being paged out, so every character in the queue is an Npc.        */
+typedef struct map_page {
+  uint8_t ter[MAP_Y][MAP_X / 2];
+  int32_t num_trainers;
+  int32_t turn_time;
+  uint32_t num_npcs;
+} map_page_t;
+
+typedef struct npc_page {
+  pair_t pos;
+  pair_t dir;
+  int32_t next_turn;
+  int32_t defeated;
+  int32_t p_init;
+  uint32_t num_pokemon;
+  character_type_t ctype;
+  movement_type_t mtype;
+  char symbol;
+} npc_page_t;
+
+/* Pages are rounded up to this, so a map usually fits back in its slot */
+#define MAP_PAGE_ROUND 4096
+
+static FILE *page_file;
+
+static void page_append(vector<char> &b, const void *v, size_t size)
+{
+  b.insert(b.end(), (const char *) v, (const char *) v + size);
+}
+
+static void page_read(void *v, size_t size)
+{
+  if (fread(v, 1, size, page_file) != size) {
+    perror("reading map page");
+    exit(1);
+  }
+}
+
+static void page_out(map_entry_t *me)
+{
+  Map *m = me->map;
+  map_page_t mp;
+  npc_page_t np;
+  Npc *c;
+  vector<char> b;
+  size_t i;
+
+  if (!page_file && !(page_file = tmpfile())) {
+    perror("tmpfile");
+    exit(1);
+  }
+
+  memcpy(mp.ter, m->ter, sizeof (mp.ter));
+  mp.num_trainers = m->num_trainers;
+  mp.turn_time = m->turn.time();
+  mp.num_npcs = 0;
+  page_append(b, &mp, sizeof (mp));
+
+  while (!m->turn.empty()) {
+    c = (Npc *) m->turn.pop();
+    np.pos[dim_x] = c->pos[dim_x];
+    np.pos[dim_y] = c->pos[dim_y];
+    np.dir[dim_x] = c->dir[dim_x];
+    np.dir[dim_y] = c->dir[dim_y];
+    np.next_turn = c->next_turn;
+    np.defeated = c->defeated;
+    np.p_init = c->p_init;
+    np.num_pokemon = c->inventory.size();
+    np.ctype = c->ctype;
+    np.mtype = c->mtype;
+    np.symbol = c->symbol;
+    page_append(b, &np, sizeof (np));
+    for (i = 0; i < c->inventory.size(); i++) {
+      page_append(b, &c->inventory[i], sizeof (c->inventory[i]));
+    }
+    ((map_page_t *) b.data())->num_npcs++;
+    delete c;
+  }
+
+  if (me->page < 0 || b.size() > me->page_size) {
+    fseek(page_file, 0, SEEK_END);
+    me->page = ftell(page_file);
+    me->page_size = ((b.size() + MAP_PAGE_ROUND - 1) / MAP_PAGE_ROUND) *
+                    MAP_PAGE_ROUND;
+  }
+  fseek(page_file, me->page, SEEK_SET);
+  if (fwrite(b.data(), 1, b.size(), page_file) != b.size()) {
+    perror("writing map page");
+    exit(1);
+  }
+
+  delete m;
+  me->map = NULL;
+}
+
+static void page_in(map_entry_t *me)
 {
-  int d, p;
-  int e, w, n, s;
+  Map *m;
+  map_page_t mp;
+  npc_page_t np;
+  Npc *c;
+  uint32_t i;
   int x, y;
 
-  if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]]) {
-    world.cur_map = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]];
-    place_pc();
+  fseek(page_file, me->page, SEEK_SET);
+  page_read(&mp, sizeof (mp));
 
-    return 0;
+  me->map = m = new Map;
+  memcpy(m->ter, mp.ter, sizeof (m->ter));
+  m->num_trainers = mp.num_trainers;
+  m->n = me->n;
+  m->s = me->s;
+  m->e = me->e;
+  m->w = me->w;
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      m->cmap[y][x] = NULL;
+    }
   }
 
-  world.cur_map                                             =
-    world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]] =
-    (Map *) malloc(sizeof (*world.cur_map));
+  m->turn.restart(mp.turn_time);
+  for (i = 0; i < mp.num_npcs; i++) {
+    page_read(&np, sizeof (np));
+    c = new Npc;
+    c->pos[dim_x] = np.pos[dim_x];
+    c->pos[dim_y] = np.pos[dim_y];
+    c->dir[dim_x] = np.dir[dim_x];
+    c->dir[dim_y] = np.dir[dim_y];
+    c->next_turn = np.next_turn;
+    c->defeated = np.defeated;
+    c->p_init = np.p_init;
+    c->ctype = np.ctype;
+    c->mtype = np.mtype;
+    c->symbol = np.symbol;
+    c->inventory.resize(np.num_pokemon);
+    if (np.num_pokemon) {
+      page_read(c->inventory.data(), np.num_pokemon * sizeof (Pokemon));
+    }
+    m->cmap[c->pos[dim_y]][c->pos[dim_x]] = c;
+    m->turn.push(c);
+  }
+}
 
-  smooth_height(world.cur_map);
+/* Adds me, which must be the most recently used, to the maps in *
+ * memory, paging out the least recently used if that's too many. */
+static void add_resident(map_entry_t *me)
+{
+  vector<map_entry_t *>::iterator i, lru;
 
-  if (!world.cur_idx[dim_y]) {
-    n = -1;
-  } else if (world.world[world.cur_idx[dim_y] - 1][world.cur_idx[dim_x]]) {
-    n = world.world[world.cur_idx[dim_y] - 1][world.cur_idx[dim_x]]->s;
-  } else {
-    n = 3 + rand() % (MAP_X - 6);
-  }
-  if (world.cur_idx[dim_y] == WORLD_SIZE - 1) {
-    s = -1;
-  } else if (world.world[world.cur_idx[dim_y] + 1][world.cur_idx[dim_x]]) {
-    s = world.world[world.cur_idx[dim_y] + 1][world.cur_idx[dim_x]]->n;
-  } else  {
-    s = 3 + rand() % (MAP_X - 6);
-  }
-  if (!world.cur_idx[dim_x]) {
-    w = -1;
-  } else if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] - 1]) {
-    w = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] - 1]->e;
-  } else {
-    w = 3 + rand() % (MAP_Y - 6);
+  world.resident.push_back(me);
+  if (world.resident.size() <= MAP_CACHE_SIZE) {
+    return;
   }
-  if (world.cur_idx[dim_x] == WORLD_SIZE - 1) {
-    e = -1;
-  } else if (world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] + 1]) {
-    e = world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x] + 1]->w;
-  } else {
-    e = 3 + rand() % (MAP_Y - 6);
+
+  for (lru = i = world.resident.begin(); i != world.resident.end(); i++) {
+    if ((*i)->last_used < (*lru)->last_used) {
+      lru = i;
+    }
+  }
+  page_out(*lru);
+  world.resident.erase(lru);
+}
+
+static void use_map(map_entry_t *me)
+{
+  me->last_used = ++world.map_clock;
+  if (!me->map) {
+    page_in(me);
+    add_resident(me);
   }
+}
+
+/* Exits belong to the edges between maps rather than to the maps, so *
+ * each comes from its edge's own stream, and the maps on either side *
+ * agree on it whichever is generated first.  (x, y) is the map south *
+ * of a north-south edge or east of an east-west one.                 */
+static int8_t edge_exit(int x, int y, map_stream_t s, int len)
+{
+  map_rng_t r;
+
+  map_rng_init(&r, x, y, s);
 
-  map_terrain(world.cur_map, n, s, e, w);
+  return 3 + map_rand(&r) % (len - 6);
+}
 
-  place_boulders(world.cur_map);
-  place_trees(world.cur_map);
-  build_paths(world.cur_map);
-  d = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
-       abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+/* Generates the map at world index (x, y).  The result depends only on *
+ * the world seed and (x, y), and nothing but m is written, so it can   *
+ * run off the main thread.                                             */
+static void generate_map(map_gen_t *m, int x, int y)
+{
+  uint32_t p;
+  int d;
+
+  m->n = y ? edge_exit(x, y, map_stream_ns_exit, MAP_X) : -1;
+  m->s = y < WORLD_SIZE - 1 ? edge_exit(x, y + 1, map_stream_ns_exit, MAP_X)
+                            : -1;
+  m->w = x ? edge_exit(x, y, map_stream_we_exit, MAP_Y) : -1;
+  m->e = x < WORLD_SIZE - 1 ? edge_exit(x + 1, y, map_stream_we_exit, MAP_Y)
+                            : -1;
+  map_rng_init(&m->rng, x, y, map_stream_terrain);
+
+  smooth_height(m);
+  map_terrain(m, m->n, m->s, m->e, m->w);
+  place_boulders(m);
+  place_trees(m);
+  build_paths(m);
+  d = (abs(x - (WORLD_SIZE / 2)) + abs(y - (WORLD_SIZE / 2)));
   p = d > 200 ? 5 : (50 - ((45 * d) / 200));
   //  printf("d=%d, p=%d\n", d, p);
-  if ((rand() % 100) < p || !d) {
-    place_pokemart(world.cur_map);
+  if ((gen_rand(m) % 100) < p || !d) {
+    place_pokemart(m);
   }
-  if ((rand() % 100) < p || !d) {
-    place_center(world.cur_map);
+  if ((gen_rand(m) % 100) < p || !d) {
+    place_center(m);
   }
+}
 
+static Map *map_from_gen(map_gen_t *g)
+{
+  Map *m;
+  int x, y;
+
+  m = new Map;
+  m->pack_terrain(g->map);
+  m->n = g->n;
+  m->s = g->s;
+  m->e = g->e;
+  m->w = g->w;
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
-      world.cur_map->cmap[y][x] = NULL;
+      m->cmap[y][x] = NULL;
+    }
+  }
+
+  return m;
+}
+
+/* While the PC is on a map, a worker thread generates the terrain of   *
+ * any of its four neighbors that don't exist yet, so that walking off  *
+ * the edge only has to place the characters.  generate_map() gives the *
+ * same map whenever and wherever it runs, so nothing the worker makes  *
+ * can disagree with the world, and a seed and key log still replay    *
+ * exactly.  A job is cancelled if the PC moves somewhere its map is no *
+ * longer a neighbor.  The job table belongs to the main thread; job    *
+ * states and the queue are shared with the worker under pregen_lock.   */
+typedef enum pregen_state {
+  pregen_queued,
+  pregen_running,
+  pregen_done
+} pregen_state_t;
+
+typedef struct pregen_job {
+  pair_t idx;
+  map_gen_t gen;
+  Map *map;
+  pregen_state_t state;
+  bool cancelled;
+} pregen_job_t;
+
+static unordered_map<uint32_t, pregen_job_t *> pregen_jobs;
+static deque<pregen_job_t *> pregen_queue;
+static mutex pregen_lock;
+static condition_variable pregen_wake, pregen_finished;
+static thread pregen_thread;
+static bool pregen_stop;
+
+static void pregen_run(pregen_job_t *j)
+{
+  generate_map(&j->gen, j->idx[dim_x], j->idx[dim_y]);
+  j->map = map_from_gen(&j->gen);
+}
+
+static void pregen_worker()
+{
+  unique_lock<mutex> lock(pregen_lock);
+  pregen_job_t *j;
+
+  while (1) {
+    while (!pregen_stop && pregen_queue.empty()) {
+      pregen_wake.wait(lock);
+    }
+    if (pregen_stop) {
+      return;
+    }
+    j = pregen_queue.front();
+    pregen_queue.pop_front();
+    j->state = pregen_running;
+
+    lock.unlock();
+    pregen_run(j);
+    lock.lock();
+
+    if (j->cancelled) {
+      delete j->map;
+      delete j;
+    } else {
+      j->state = pregen_done;
+      pregen_finished.notify_all();
+    }
+  }
+}
+
+/* Takes j out of the table and frees it, or leaves that to the worker *
+ * if it's running.  pregen_lock must be held.                         */
+static void pregen_drop(pregen_job_t *j)
+{
+  pregen_jobs.erase(world_key(j->idx[dim_x], j->idx[dim_y]));
+  if (j->state == pregen_queued) {
+    pregen_queue.erase(find(pregen_queue.begin(), pregen_queue.end(), j));
+    delete j;
+  } else if (j->state == pregen_running) {
+    j->cancelled = true;
+  } else {
+    delete j->map;
+    delete j;
+  }
+}
+
+static void pregen_shutdown()
+{
+  unordered_map<uint32_t, pregen_job_t *>::iterator i;
+
+  pregen_lock.lock();
+  while ((i = pregen_jobs.begin()) != pregen_jobs.end()) {
+    pregen_drop(i->second);
+  }
+  pregen_stop = true;
+  pregen_wake.notify_one();
+  pregen_lock.unlock();
+
+  if (pregen_thread.joinable()) {
+    pregen_thread.join();
+  }
+  pregen_stop = false;
+}
+
+static void pregen_neighbors()
+{
+  static const int8_t dir[4][2] = { { 0, -1 }, { 0, 1 }, { 1, 0 }, { -1, 0 } };
+  static bool registered;
+  unordered_map<uint32_t, pregen_job_t *>::iterator i, next;
+  lock_guard<mutex> lock(pregen_lock);
+  pregen_job_t *j;
+  int k, x, y;
+
+  for (i = pregen_jobs.begin(); i != pregen_jobs.end(); i = next) {
+    next = i;
+    next++;
+    j = i->second;
+    if (abs(j->idx[dim_x] - world.cur_idx[dim_x]) +
+        abs(j->idx[dim_y] - world.cur_idx[dim_y]) != 1) {
+      pregen_drop(j);
+    }
+  }
+
+  for (k = 0; k < 4; k++) {
+    x = world.cur_idx[dim_x] + dir[k][dim_x];
+    y = world.cur_idx[dim_y] + dir[k][dim_y];
+    if (x < 0 || x >= WORLD_SIZE || y < 0 || y >= WORLD_SIZE ||
+        world_entry(x, y) || pregen_jobs.count(world_key(x, y))) {
+      continue;
+    }
+    j = new pregen_job_t;
+    j->idx[dim_x] = x;
+    j->idx[dim_y] = y;
+    j->map = NULL;
+    j->state = pregen_queued;
+    j->cancelled = false;
+    pregen_jobs[world_key(x, y)] = j;
+    pregen_queue.push_back(j);
+  }
+
+  if (!pregen_queue.empty()) {
+    if (!pregen_thread.joinable()) {
+      // Replays and fatal errors end in exit(); the thread can't outlive it
+      if (!registered) {
+        atexit(pregen_shutdown);
+        registered = true;
+      }
+      pregen_thread = thread(pregen_worker);
+    }
+    pregen_wake.notify_one();
+  }
+}
+
+/* The pre-generated map for world index (x, y), if it was queued */
+static Map *pregen_adopt(int x, int y)
+{
+  unordered_map<uint32_t, pregen_job_t *>::iterator i;
+  unique_lock<mutex> lock(pregen_lock);
+  pregen_job_t *j;
+  Map *m;
+
+  if ((i = pregen_jobs.find(world_key(x, y))) == pregen_jobs.end()) {
+    return NULL;
+  }
+  j = i->second;
+  pregen_jobs.erase(i);
+
+  if (j->state == pregen_queued) {
+    // The worker hasn't started it; quicker to do it here than to wait
+    pregen_queue.erase(find(pregen_queue.begin(), pregen_queue.end(), j));
+    lock.unlock();
+    pregen_run(j);
+  } else {
+    while (j->state != pregen_done) {
+      pregen_finished.wait(lock);
     }
+    lock.unlock();
   }
 
-  heap_init(&world.cur_map->turn, cmp_char_turns, delete_character);
+  m = j->map;
+  delete j;
+
+  return m;
+}
+
+// New map expects cur_idx to refer to the index to be generated.  If that
+// map has already been generated then the only thing this does is set
+// cur_map.
+int new_map(int teleport)
+{
+  map_entry_t *me;
+  Map *m;
+  static map_gen_t gen;
+
+  if ((me = world_entry(world.cur_idx[dim_x], world.cur_idx[dim_y]))) {
+    use_map(me);
+    world.cur_map = me->map;
+    place_pc();
+    pregen_neighbors();
+
+    return 0;
+  }
+
+  if (!(m = pregen_adopt(world.cur_idx[dim_x], world.cur_idx[dim_y]))) {
+    generate_map(&gen, world.cur_idx[dim_x], world.cur_idx[dim_y]);
+    m = map_from_gen(&gen);
+  }
+
+  me = &world.maps[world_key(world.cur_idx[dim_x], world.cur_idx[dim_y])];
+  world.cur_map = me->map = m;
+  me->n = m->n;
+  me->s = m->s;
+  me->e = m->e;
+  me->w = m->w;
+  me->page = -1;
+  me->page_size = 0;
+  me->last_used = ++world.map_clock;
+  add_resident(me);
 
   if ((world.cur_idx[dim_x] == WORLD_SIZE / 2) &&
       (world.cur_idx[dim_y] == WORLD_SIZE / 2)) {
@@ -1098,22 +1346,34 @@ int new_map(int teleport)
     place_pc();
   }
 
-  pathfind(world.cur_map);
   if (teleport) {
+    /* Where the PC stood on the last map may be a tree or a boulder *
+     * here, and nothing is reachable from those.  Measure from some  *
+     * road instead, so that the PC lands where the roads lead.      */
+    world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+    do {
+      world.pc.pos[dim_x] = rand_range(1, MAP_X - 2);
+      world.pc.pos[dim_y] = rand_range(1, MAP_Y - 2);
+    } while (world.cur_map->terrain(world.pc.pos[dim_x],
+                                    world.pc.pos[dim_y]) != ter_path);
+    pathfind(world.cur_map);
     do {
       world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
       world.pc.pos[dim_x] = rand_range(1, MAP_X - 2);
       world.pc.pos[dim_y] = rand_range(1, MAP_Y - 2);
     } while (world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ||
-             (move_cost[char_pc][world.cur_map->map[world.pc.pos[dim_y]]
-                                                   [world.pc.pos[dim_x]]] ==
+             (move_cost[char_pc][world.cur_map->terrain(world.pc.pos[dim_x],
+                                                        world.pc.pos[dim_y])] ==
               INT_MAX)                                                      ||
+             world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ==
+             INT_MAX                                                        ||
              world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] < 0);
     world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
-    pathfind(world.cur_map);
   }
+  pathfind(world.cur_map);
 
   place_characters();
+  pregen_neighbors();
 
   return 0;
 }
@@ -1131,7 +1391,7 @@ static void print_map()
       if (world.cur_map->cmap[y][x]) {
         putchar(world.cur_map->cmap[y][x]->symbol);
       } else {
-        switch (world.cur_map->map[y][x]) {
+        switch (world.cur_map->terrain(x, y)) {
         case ter_boulder:
         case ter_mountain:
           putchar('%');
@@ -1180,19 +1440,21 @@ void init_world()
 
 void delete_world()
 {
-  int x, y;
+  vector<map_entry_t *>::iterator i;
 
-  //Only correct because current game never leaves the initial map
-  //Need to iterate over all maps in 1.05+
-  heap_delete(&world.cur_map->turn);
+  pregen_shutdown();
 
-  for (y = 0; y < WORLD_SIZE; y++) {
-    for (x = 0; x < WORLD_SIZE; x++) {
-      if (world.world[y][x]) {
-        free(world.world[y][x]);
-        world.world[y][x] = NULL;
-      }
+  for (i = world.resident.begin(); i != world.resident.end(); i++) {
+    while (!(*i)->map->turn.empty()) {
+      delete_character((*i)->map->turn.pop());
     }
+    delete (*i)->map;
+  }
+  world.resident.clear();
+  world.maps.clear();
+  if (page_file) {
+    fclose(page_file);
+    page_file = NULL;
   }
 }
 
@@ -1242,70 +1504,474 @@ void leave_map(pair_t d)
   new_map(0);
 }
 
+/* Where game_loop() spends its time, measured in headless and replay *
+ * runs.                                                              */
+typedef enum sim_phase {
+  phase_turn_queue,
+  phase_npc_move,
+  phase_pc_move,
+  phase_map_change,
+  phase_pathfind,
+  num_sim_phases
+} sim_phase_t;
+
+static const char *sim_phase_name[num_sim_phases] = {
+  "turn queue",
+  "NPC moves",
+  "PC moves",
+  "map changes",
+  "pathfinding",
+};
+
+static uint64_t sim_phase_ns[num_sim_phases];
+static uint64_t sim_turns, sim_turn_budget, sim_start, sim_map_changes;
+static int sim_timing;
+
+static uint64_t sim_clock()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Charges the time since *t to phase p and restarts the clock */
+static void sim_phase_end(sim_phase_t p, uint64_t *t)
+{
+  uint64_t now;
+
+  if (sim_timing) {
+    now = sim_clock();
+    sim_phase_ns[p] += now - *t;
+    *t = now;
+  }
+}
+
+/* --trace writes the operations on the turn queue of the PC's map to a *
+ * file that bench_heap can replay; see read_trace() there.  Each push   *
+ * gets an item id, which can only be given out again once every        *
+ * correct queue would have popped it: after a pop of a later turn.     *
+ * Ties may come out of bench_heap's queues in another order than ours, *
+ * so reusing the id of the character just popped could insert an item *
+ * that's still queued.  When the PC changes maps, the queue is drained *
+ * and refilled with the characters on the new map.                     */
+static FILE *turn_trace;
+static Map *turn_trace_map;
+static uint32_t turn_trace_depth, turn_trace_ids;
+static vector<uint32_t> turn_trace_free;
+static priority_queue<pair<int, uint32_t>, vector<pair<int, uint32_t> >,
+                      greater<pair<int, uint32_t> > > turn_trace_queued;
+
+static void trace_push(Character *c)
+{
+  uint32_t id;
+
+  if (turn_trace_free.empty()) {
+    id = turn_trace_ids++;
+  } else {
+    id = turn_trace_free.back();
+    turn_trace_free.pop_back();
+  }
+  turn_trace_queued.push(make_pair(c->next_turn, id));
+  turn_trace_depth++;
+  fprintf(turn_trace, "i %u %d\n", id, c->next_turn);
+}
+
+static void trace_pop(Character *c)
+{
+  while (!turn_trace_queued.empty() &&
+         turn_trace_queued.top().first < c->next_turn) {
+    turn_trace_free.push_back(turn_trace_queued.top().second);
+    turn_trace_queued.pop();
+  }
+  turn_trace_depth--;
+  fputs("r\n", turn_trace);
+}
+
+/* Starts over on the current map if the PC has left the traced one.  *
+ * Every character on the map is in its queue but c, which is about   *
+ * to be pushed.                                                      */
+static void trace_sync(Character *c)
+{
+  int x, y;
+
+  if (world.cur_map == turn_trace_map) {
+    return;
+  }
+
+  for (; turn_trace_depth; turn_trace_depth--) {
+    fputs("r\n", turn_trace);
+  }
+  turn_trace_queued = decltype(turn_trace_queued)();
+  turn_trace_free.clear();
+  turn_trace_ids = 0;
+  turn_trace_map = world.cur_map;
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      if (world.cur_map->cmap[y][x] && world.cur_map->cmap[y][x] != c) {
+        trace_push(world.cur_map->cmap[y][x]);
+      }
+    }
+  }
+}
+
 void game_loop()
 {
   Character *c;
   Npc *n;
   Pc *p;
   pair_t d;
+  uint64_t t;
+  int cost;
+
+  t = sim_timing ? sim_clock() : 0;
+  if (turn_trace) {
+    trace_sync(NULL);
+  }
 
   while (!world.quit) {
-    c = (Character *) heap_remove_min(&world.cur_map->turn);
+    c = world.cur_map->turn.pop();
+    if (turn_trace) {
+      trace_pop(c);
+    }
     n = dynamic_cast<Npc *> (c);
     p = dynamic_cast<Pc *> (c);
+    sim_phase_end(phase_turn_queue, &t);
 
     move_func[n ? n->mtype : move_pc](c, d);
+    sim_phase_end(p ? phase_pc_move : phase_npc_move, &t);
 
     world.cur_map->cmap[c->pos[dim_y]][c->pos[dim_x]] = NULL;
     if (p && (d[dim_x] == 0 || d[dim_x] == MAP_X - 1 ||
               d[dim_y] == 0 || d[dim_y] == MAP_Y - 1)) {
       leave_map(d);
+      sim_map_changes++;
       d[dim_x] = c->pos[dim_x];
       d[dim_y] = c->pos[dim_y];
+      sim_phase_end(phase_map_change, &t);
     }
     world.cur_map->cmap[d[dim_y]][d[dim_x]] = c;
 
     if (p) {
-      // Performance bug - pathfinding runs twice after generating a new map
       pathfind(world.cur_map);
+      sim_phase_end(phase_pathfind, &t);
     }
 
-    c->next_turn += move_cost[n ? n->ctype : char_pc]
-                             [world.cur_map->map[d[dim_y]][d[dim_x]]];
+    // Nothing moves where it can't go, so next_turn can't wrap
+    cost = move_cost[n ? n->ctype : char_pc]
+                    [world.cur_map->terrain(d[dim_x], d[dim_y])];
+    assert(cost != INT_MAX && c->next_turn <= INT_MAX - cost);
+    c->next_turn += cost;
 
     c->pos[dim_y] = d[dim_y];
     c->pos[dim_x] = d[dim_x];
 
-    heap_insert(&world.cur_map->turn, c);
+    if (turn_trace) {
+      trace_sync(c);
+      trace_push(c);
+    }
+    world.cur_map->turn.push(c);
+    sim_phase_end(phase_turn_queue, &t);
+
+    if (++sim_turns == sim_turn_budget) {
+      world.quit = 1;
+    }
+  }
+}
+
+static void print_sim_stats(uint64_t ns)
+{
+  int i;
+
+  printf("%llu turns in %.3f s: %.0f turns/s\n",
+         (unsigned long long) sim_turns, ns / 1e9,
+         ns ? sim_turns * 1e9 / ns : 0.0);
+  printf("PC changed maps %llu times; %zu maps generated\n",
+         (unsigned long long) sim_map_changes, world.maps.size());
+  for (i = 0; i < num_sim_phases; i++) {
+    printf("  %-12s %10.3f ms %6.1f%% %8.1f ns/turn\n", sim_phase_name[i],
+           sim_phase_ns[i] / 1e6, ns ? sim_phase_ns[i] * 100.0 / ns : 0.0,
+           sim_turns ? (double) sim_phase_ns[i] / sim_turns : 0.0);
   }
 }
 
+/* Ends a replay, whether the log ran out or the player quit */
+void end_replay()
+{
+  uint64_t ns = sim_clock() - sim_start;
+
+  io_reset_terminal();
+  printf("Replayed ");
+  print_sim_stats(ns);
+
+  exit(0);
+}
+
+#define CHECK_ENTRIES 5
+
+/* Generates world index (x, y) afresh, with the PC walking in from its *
+ * neighbor on side k (0 through 3: north, south, east, west) or, for  *
+ * k == 4, flying in and landing at random.                            */
+static void check_enter(int x, int y, int k)
+{
+  static const int8_t side[4][2] = { { 0, -1 }, { 0, 1 }, { 1, 0 }, { -1, 0 } };
+  map_entry_t *ne;
+  pair_t d;
+
+  delete_world();
+  init_world();
+  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+  if (k == 4) {
+    world.cur_idx[dim_x] = x;
+    world.cur_idx[dim_y] = y;
+    new_map(1);
+
+    return;
+  }
+  world.cur_idx[dim_x] = x + side[k][dim_x];
+  world.cur_idx[dim_y] = y + side[k][dim_y];
+  new_map(1);
+  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+
+  // Stand by the neighbor's exit toward (x, y) and step through it
+  ne = world_entry(world.cur_idx[dim_x], world.cur_idx[dim_y]);
+  switch (k) {
+  case 0:
+    world.pc.pos[dim_x] = d[dim_x] = ne->s;
+    world.pc.pos[dim_y] = MAP_Y - 2;
+    d[dim_y] = MAP_Y - 1;
+    break;
+  case 1:
+    world.pc.pos[dim_x] = d[dim_x] = ne->n;
+    world.pc.pos[dim_y] = 1;
+    d[dim_y] = 0;
+    break;
+  case 2:
+    world.pc.pos[dim_x] = 1;
+    d[dim_x] = 0;
+    world.pc.pos[dim_y] = d[dim_y] = ne->w;
+    break;
+  case 3:
+    world.pc.pos[dim_x] = MAP_X - 2;
+    d[dim_x] = MAP_X - 1;
+    world.pc.pos[dim_y] = d[dim_y] = ne->e;
+    break;
+  }
+  leave_map(d);
+}
+
+/* One line per trainer on the current map, sorted, saying who it is *
+ * and, in positions, where it stands.                               */
+static void check_trainers(vector<string> *trainers, vector<string> *positions)
+{
+  char s[256];
+  Pokemon *p;
+  Npc *n;
+  int x, y;
+
+  trainers->clear();
+  positions->clear();
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      if (!(n = dynamic_cast<Npc *> (world.cur_map->cmap[y][x]))) {
+        continue;
+      }
+      p = &n->inventory[0];
+      snprintf(s, sizeof (s), "%s %c %d,%d: %s %s level %d, %d %d %d %d %d %d, "
+               "%s %s", char_type_name[n->ctype], n->symbol,
+               n->dir[dim_x], n->dir[dim_y], p->gender, p->identifier,
+               p->level, p->hp, p->atk, p->def, p->spd, p->spa, p->sd,
+               p->move1, p->move2);
+      trainers->push_back(s);
+      snprintf(s, sizeof (s), "%s at %d,%d", trainers->back().c_str(), x, y);
+      positions->push_back(s);
+    }
+  }
+  sort(trainers->begin(), trainers->end());
+  sort(positions->begin(), positions->end());
+}
+
+/* Generates maps at random, each one afresh every way the PC can get *
+ * there, and checks that the same trainers are placed whichever way  *
+ * it came.  Where they stand may differ when the PC flies in, since  *
+ * it can land on a spot a trainer would have had.  Returns the       *
+ * number of maps where the trainers weren't the same.                */
+static int check_maps(uint32_t num_maps)
+{
+  static const char *entry_name[CHECK_ENTRIES] = {
+    "the north", "the south", "the east", "the west", "the air"
+  };
+  vector<string> trainers[CHECK_ENTRIES], positions[CHECK_ENTRIES], moved;
+  uint32_t i, j, failed;
+  int x, y, k;
+
+  for (failed = i = 0; i < num_maps; i++) {
+    do {
+      x = rand_range(1, WORLD_SIZE - 2);
+      y = rand_range(1, WORLD_SIZE - 2);
+    } while (x == WORLD_SIZE / 2 && y == WORLD_SIZE / 2);
+
+    for (k = 0; k < CHECK_ENTRIES; k++) {
+      check_enter(x, y, k);
+      check_trainers(trainers + k, positions + k);
+    }
+
+    for (k = 1; k < CHECK_ENTRIES && trainers[k] == trainers[0]; k++)
+      ;
+    if (k < CHECK_ENTRIES) {
+      printf("Map (%d, %d): trainers differ\n", x - WORLD_SIZE / 2,
+             y - WORLD_SIZE / 2);
+      for (j = 0; j < CHECK_ENTRIES; j++) {
+        printf("  from %s:\n", entry_name[j]);
+        for (string &t : trainers[j]) {
+          printf("    %s\n", t.c_str());
+        }
+      }
+      failed++;
+      continue;
+    }
+
+    for (moved.clear(), k = 1; k < CHECK_ENTRIES; k++) {
+      set_difference(positions[k].begin(), positions[k].end(),
+                     positions[0].begin(), positions[0].end(),
+                     back_inserter(moved));
+    }
+    printf("Map (%d, %d): %zu trainers, the same every way in; "
+           "%zu placements moved\n", x - WORLD_SIZE / 2, y - WORLD_SIZE / 2,
+           trainers[0].size(), moved.size());
+  }
+  delete_world();
+
+  printf("%u of %u maps placed different trainers\n", failed, num_maps);
+
+  return failed;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [--headless turns | --record log | --replay log |"
+          " --check maps] [--trace file] [seed]\n", name);
+  exit(1);
+}
+
+/* Usage: poke327 [--headless turns | --record log | --replay log |      *
+ *                 --check maps] [--trace file] [seed]                    *
+ * --headless runs without a terminal, the PC wandering at random and     *
+ * every battle going to the PC, for the given number of character turns  *
+ * (0 runs until killed), then prints how fast it went.  --record saves   *
+ * the seed and every key to a log, and --replay plays a log back, as     *
+ * fast as it can and without a terminal, and prints timings.  --trace    *
+ * writes the turn queue's operations for bench_heap to replay.  --check  *
+ * generates the given number of maps every way the PC can enter them and *
+ * fails unless each gets the same trainers whichever way it came.        */
 int main(int argc, char *argv[])
 {
   struct timeval tv;
   uint32_t seed;
+  int i, have_seed;
+  const char *record, *replay, *trace;
+  char *end;
+  uint64_t start;
+  uint32_t check;
   //  char c;
   //  int x, y;
 
+  have_seed = 0;
+  record = replay = trace = NULL;
+  check = 0;
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--headless")) {
+      if (++i == argc || !isdigit(argv[i][0]) ||
+          (sim_turn_budget = strtoull(argv[i], &end, 10), *end)) {
+        usage(argv[0]);
+      }
+      world.headless = sim_timing = 1;
+    } else if (!strcmp(argv[i], "--record")) {
+      if (++i == argc) {
+        usage(argv[0]);
+      }
+      record = argv[i];
+    } else if (!strcmp(argv[i], "--replay")) {
+      if (++i == argc) {
+        usage(argv[0]);
+      }
+      replay = argv[i];
+    } else if (!strcmp(argv[i], "--check")) {
+      if (++i == argc || !isdigit(argv[i][0]) ||
+          !(check = strtoul(argv[i], &end, 10)) || *end) {
+        usage(argv[0]);
+      }
+    } else if (!strcmp(argv[i], "--trace")) {
+      if (++i == argc) {
+        usage(argv[0]);
+      }
+      trace = argv[i];
+    } else if (!strncmp(argv[i], "--", 2)) {
+      usage(argv[0]);
+    } else {
+      seed = atoi(argv[i]);
+      have_seed = 1;
+    }
+  }
+
+  // Only one of them can drive the PC
+  if ((world.headless != 0) + (record != NULL) + (replay != NULL) +
+      (check != 0) > 1) {
+    usage(argv[0]);
+  }
+
   db_parse(true);
 
 
 
-  if (argc == 2) {
-    seed = atoi(argv[1]);
-  } else {
+  if (replay) {
+    if (io_replay_start(replay, &seed)) {
+      return 1;
+    }
+    sim_timing = 1;
+  } else if (!have_seed) {
     gettimeofday(&tv, NULL);
     seed = (tv.tv_usec ^ (tv.tv_sec << 20)) & 0xffffffff;
   }
+  if (record && io_record_start(record, seed)) {
+    return 1;
+  }
+  if (trace && !(turn_trace = fopen(trace, "w"))) {
+    perror(trace);
+    return 1;
+  }
 
   printf("Using seed: %u\n", seed);
   srand(seed);
+  world.seed = seed;
+
+  if (check) {
+    return check_maps(check) ? 1 : 0;
+  }
+
+  /* A replay takes its keys from the log and has nothing to show, so *
+   * it runs here too, without a terminal.  The screen calls it makes  *
+   * along the way fail harmlessly, since curses was never started.   */
+  if (world.headless || replay) {
+    sim_start = start = sim_clock();
+    init_world();
+    game_loop();
+    if (replay) {
+      end_replay();
+    }
+    print_sim_stats(sim_clock() - start);
+    delete_world();
+
+    return 0;
+  }
 
   io_init_terminal();
   io_init_terminal();
   init_world();
 
-   print_hiker_dist();
+  print_hiker_dist();
 
    game_loop();
 
@@ -4,7 +4,10 @@
 # include <stdlib.h>
 # include <assert.h>
 #include <vector>
+#include <unordered_map>
 # include "heap.h"
+# include "pqueue.h"
+# include "twheel.h"
 # include "character.h"
 
 using namespace std;
@@ -41,6 +44,7 @@ typedef int16_t pair_t[num_dims];
 #define WORLD_SIZE         401
 #define MIN_TRAINERS       7
 #define ADD_TRAINER_PROB   50
+#define MAP_CACHE_SIZE     64
 
 #define mappair(pair) (m->map[pair[dim_y]][pair[dim_x]])
 #define mapxy(x, y) (m->map[y][x])
@@ -83,14 +87,56 @@ typedef enum __attribute__ ((__packed__)) character_type {
 
 class Character;
 
+/* Characters take turns in order of next_turn, first come first *
+ * served among equals.                                           */
+struct turn_key {
+  int32_t operator()(const Character *c) const;
+};
+
+struct turn_link {
+  Character **operator()(Character *c) const;
+};
+
+static_assert(num_terrain_types <= 16, "terrain must fit in 4 bits");
+static_assert(!(MAP_X & 1), "terrain is packed in pairs of cells");
+
 class Map {
  public:
-  terrain_type_t map[MAP_Y][MAP_X];
-  uint8_t height[MAP_Y][MAP_X];
+  /* Terrain is packed two cells to a byte, low nibble first.  Maps are *
+   * generated unpacked, with heights, and packed once they're done.    */
+  uint8_t ter[MAP_Y][MAP_X / 2];
   Character *cmap[MAP_Y][MAP_X];
-  heap_t turn;
+  twheel<Character *, turn_key, turn_link> turn;
   int32_t num_trainers;
   int8_t n, s, e, w;
+
+  terrain_type_t terrain(int x, int y) const
+  {
+    return (terrain_type_t) ((ter[y][x >> 1] >> ((x & 1) << 2)) & 0xf);
+  }
+
+  void pack_terrain(const terrain_type_t (*map)[MAP_X])
+  {
+    int x, y;
+
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x += 2) {
+        ter[y][x >> 1] = map[y][x] | (map[y][x + 1] << 4);
+      }
+    }
+  }
+
+  void unpack_terrain(terrain_type_t (*map)[MAP_X]) const
+  {
+    int x, y;
+
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x += 2) {
+        map[y][x] = (terrain_type_t) (ter[y][x >> 1] & 0xf);
+        map[y][x + 1] = (terrain_type_t) (ter[y][x >> 1] >> 4);
+      }
+    }
+  }
 };
 
 
@@ -110,11 +156,12 @@ class Pokemon{
     char identifier[30];
     char move1[30];
     char move2[30];
-    int move_priority[1];
-    int power[1];
-    int accuracy[1];
+    int move_priority[2];
+    int power[2];
+    int accuracy[2];
+    int move_type[2];
     int type_id;
-    int atk_id[1];
+    int atk_id[2];
     int capture_rate;
 
 
@@ -124,9 +171,20 @@ class Character {
   pair_t pos;
   char symbol;
   int next_turn;
+  Character *turn_next;
   vector<Pokemon> inventory;
   virtual ~Character() {}
 };
+
+inline int32_t turn_key::operator()(const Character *c) const
+{
+  return c->next_turn;
+}
+
+inline Character **turn_link::operator()(Character *c) const
+{
+  return &c->turn_next;
+}
 class Pc : public Character {
  public:
    int pokeballs;
@@ -143,9 +201,24 @@ class Npc : public Character {
   int p_init;
   pair_t dir;
 };
+/* What the world keeps for every map generated so far.  At most       *
+ * MAP_CACHE_SIZE maps are in memory; the least recently used of the   *
+ * rest are paged out to a file and read back when the PC returns.     *
+ * The exits stay here either way so that new neighbors can line up.  */
+typedef struct map_entry {
+  Map *map;
+  int8_t n, s, e, w;
+  uint64_t last_used;
+  long page;
+  uint32_t page_size;
+} map_entry_t;
+
 class World {
  public:
-  Map *world[WORLD_SIZE][WORLD_SIZE];
+  /* Keyed by world_key(); use world_entry() to look maps up. */
+  unordered_map<uint32_t, map_entry_t> maps;
+  vector<map_entry_t *> resident;
+  uint64_t map_clock;
   pair_t cur_idx;
   Map *cur_map;
   /* Please distance maps in world, not map, since *
@@ -155,16 +228,81 @@ class World {
   Pc pc;
   vector<Pokemon> storage;
   int quit;
+  int headless;
+  /* Set once at startup; everything generated derives from it */
+  uint32_t seed;
 };
 
 extern const char *char_type_name[num_character_types];
 extern int32_t move_cost[num_character_types][num_terrain_types];
 extern void (*move_func[num_movement_types])(Character *, pair_t);
 
-/* Even unallocated, a WORLD_SIZE x WORLD_SIZE array of pointers is a very *
- * large thing to put on the stack.  To avoid that, world is a global.     */
+/* Everything needs the world, so world is a global. */
 extern World world;
 
+/* Nothing here depends on WORLD_SIZE beyond fitting in a pair_t, so the *
+ * world can grow without costing anything until maps are generated.    */
+inline uint32_t world_key(int x, int y)
+{
+  return ((uint32_t) (uint16_t) y << 16) | (uint16_t) x;
+}
+
+/* The entry for world index (x, y), or NULL if it hasn't been generated. *
+ * Its map may be paged out; new_map() brings it back.                   */
+inline map_entry_t *world_entry(int x, int y)
+{
+  unordered_map<uint32_t, map_entry_t>::iterator i;
+
+  i = world.maps.find(world_key(x, y));
+
+  return i == world.maps.end() ? NULL : &i->second;
+}
+
+/* A counter-based generator: the nth number of a stream is a hash of the *
+ * stream's key and n (splitmix64's output function), so a map's streams *
+ * give the same numbers on any thread, whatever order maps are made in.  *
+ * Keys come from the world seed, a world index and what the stream is    *
+ * for.  Numbers are in [0, RAND_MAX], like rand()'s.                     */
+typedef enum map_stream {
+  map_stream_terrain,
+  map_stream_characters,
+  map_stream_ns_exit,
+  map_stream_we_exit,
+  map_stream_positions
+} map_stream_t;
+
+typedef struct map_rng {
+  uint64_t key;
+  uint64_t n;
+} map_rng_t;
+
+inline uint64_t map_rng_mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+inline void map_rng_init(map_rng_t *r, int x, int y, map_stream_t s)
+{
+  r->key = map_rng_mix((((uint64_t) world.seed << 32) | world_key(x, y)) ^
+                       map_rng_mix(s + 1));
+  r->n = 0;
+}
+
+inline uint32_t map_rand(map_rng_t *r)
+{
+  return map_rng_mix(r->key + ++r->n * 0x9e3779b97f4a7c15ULL) >> 33;
+}
+
+/* Substream i of r, independent of r and of every other i */
+inline void map_rng_split(map_rng_t *sub, const map_rng_t *r, uint32_t i)
+{
+  sub->key = map_rng_mix(r->key ^ map_rng_mix(i + 1ULL));
+  sub->n = 0;
+}
+
 extern pair_t all_dirs[8];
 
 #define rand_dir(dir) {     \
@@ -174,12 +312,13 @@ extern pair_t all_dirs[8];
 }
 
 typedef struct path {
-  heap_node_t *hn;
+  uint32_t qpos;
   uint8_t pos[2];
   uint8_t from[2];
   int32_t cost;
 } path_t;
 
 int new_map(int teleport);
+void end_replay(void);
 
 #endif
@@ -0,0 +1,107 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "poke327.h"
+#include "pokemon.h"
+#include "db_parse.h"
+
+static uint32_t pokemon_rand(map_rng_t *r)
+{
+  return r ? map_rand(r) : rand();
+}
+
+int pokemon_level_here(map_rng_t *r)
+{
+  int distance;
+
+  distance = (abs(world.cur_idx[dim_x] - (WORLD_SIZE / 2)) +
+              abs(world.cur_idx[dim_y] - (WORLD_SIZE / 2)));
+
+  if (distance <= 200) {
+    return distance > 1 ? pokemon_rand(r) % (distance / 2) + 1 : 1;
+  }
+  if ((distance - 200) / 2) {
+    return pokemon_rand(r) % ((distance - 200) / 2) + 1;
+  }
+
+  return 1;
+}
+
+static int calc_stat(int base, int iv, int level)
+{
+  return ((((base + iv) * 2) * level) / 100) + 5;
+}
+
+void make_pokemon(Pokemon *p, map_rng_t *r)
+{
+  const pokemon_base_db *base;
+  const learnset_move_db *viable;
+  const move_db *m;
+  int j, row, size, move_id[2], iv[6];
+  uint32_t bits;
+
+  p->level = pokemon_level_here(r);
+
+  /* Rows 1 through num_species of pokemon[] are the default forms.  *
+   * A species with nothing to learn yet at this level can't fight.  *
+   * If the rerolls run out, the next one after the last pick that   *
+   * can is taken; db_parse() made sure one can at every level.      */
+  for (j = 0; j < num_species; j++) {
+    row = pokemon_rand(r) % num_species + 1;
+    if ((size = learnset_lookup(pokemon[row].id, p->level, &viable))) {
+      break;
+    }
+  }
+  for (j = 0; !size && j < num_species; j++) {
+    row = row % num_species + 1;
+    size = learnset_lookup(pokemon[row].id, p->level, &viable);
+  }
+  base = &pokemon_base[pokemon[row].id];
+  strcpy(p->identifier, pokemon[row].identifier);
+
+  /* One draw covers all six 4-bit IVs and the gender bit */
+  bits = pokemon_rand(r);
+  for (j = 0; j < 6; j++) {
+    iv[j] = (bits >> (4 * j)) & 0xf;
+  }
+  strcpy(p->gender, (bits >> 24) & 1 ? "Female" : "Male");
+  if (!(pokemon_rand(r) % 8192)) {
+    /* Shiny */
+    for (j = 0; j < 6; j++) {
+      iv[j] = 10;
+    }
+  }
+
+  p->base_speed = base->base_stat[3];
+  p->hp = calc_stat(base->base_stat[0], iv[0], p->level) + p->level + 5;
+  p->default_hp = p->hp;
+  p->atk = calc_stat(base->base_stat[1], iv[1], p->level);
+  p->def = calc_stat(base->base_stat[2], iv[2], p->level);
+  p->spd = calc_stat(base->base_stat[3], iv[3], p->level);
+  p->spa = calc_stat(base->base_stat[4], iv[4], p->level);
+  p->sd = calc_stat(base->base_stat[5], iv[5], p->level);
+  p->atk_id[0] = base->type_id[0];
+  p->atk_id[1] = base->type_id[1];
+  p->capture_rate = base->capture_rate;
+
+  move_id[0] = viable[pokemon_rand(r) % size].move_id;
+  move_id[1] = viable[pokemon_rand(r) % size].move_id;
+  if (move_id[0] == move_id[1]) {
+    move_id[1] = viable[pokemon_rand(r) % size].move_id;
+  }
+
+  for (j = 0; j < 2; j++) {
+    m = move_lookup(move_id[j]);
+    p->power[j] = m->power;
+    if (p->power[j] == 0 || p->power[j] == -1) {
+      /* Status moves have no power; give them some so they can hit */
+      p->power[j] = pokemon_rand(r) % 100;
+    }
+    p->accuracy[j] = m->accuracy;
+    p->move_priority[j] = m->priority;
+    p->move_type[j] = m->type_id;
+  }
+  p->type_id = move_lookup(move_id[0])->type_id;
+  strcpy(p->move1, move_lookup(move_id[0])->identifier);
+  strcpy(p->move2, move_lookup(move_id[1])->identifier);
+}
@@ -0,0 +1,19 @@
+#ifndef POKEMON_H
+# define POKEMON_H
+
+class Pokemon;
+typedef struct map_rng map_rng_t;
+
+/* Level for a Pokemon met on the current map; grows with the map's *
+ * distance from the center of the world.  Draws from r, or from     *
+ * rand() if r is NULL.                                              */
+int pokemon_level_here(map_rng_t *r);
+
+/* Fills in p as a random Pokemon at pokemon_level_here()'s level.  *
+ * This is the only place Pokemon are made; wild encounters,         *
+ * trainers and the starter choice all use it.  Trainers placed with *
+ * a map draw from the map's stream r; everything met during play    *
+ * passes NULL and draws from rand().                                */
+void make_pokemon(Pokemon *p, map_rng_t *r);
+
+#endif
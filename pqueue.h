@@ -0,0 +1,125 @@
+#ifndef PQUEUE_H
+# define PQUEUE_H
+
+# include <stdint.h>
+# include <vector>
+
+/* Position of an element that isn't in a queue */
+# define PQUEUE_NOT_QUEUED UINT32_MAX
+
+/* For queues that never need decrease_key(). */
+template <class T>
+struct pqueue_no_index {
+  uint32_t *operator()(T) const { return 0; }
+};
+
+/* A min-heap of T, in the order given by Less, in one 4-ary array.    *
+ * Less is a type rather than a function pointer, so every comparison  *
+ * is inlined; it's called as less(a, b) and is true if a goes first.  *
+ * For decrease_key(), Index returns a pointer to where each element   *
+ * keeps its position in the queue; it's PQUEUE_NOT_QUEUED once the    *
+ * element is removed.  The C heaps in heap.h and dheap.h are still    *
+ * there for code that wants a void * interface.                       */
+template <class T, class Less, class Index = pqueue_no_index<T> >
+class pqueue {
+ public:
+  bool empty() const { return a.empty(); }
+  uint32_t size() const { return a.size(); }
+
+  /* The element that goes first.  The queue must not be empty. */
+  T top() const { return a[0]; }
+
+  void push(T v)
+  {
+    a.push_back(v);
+    sift_up(a.size() - 1);
+  }
+
+  /* Removes and returns the element that goes first.  The queue must *
+   * not be empty.                                                    */
+  T pop()
+  {
+    T v = a[0];
+
+    set_pos(v, PQUEUE_NOT_QUEUED);
+    if (a.size() > 1) {
+      a[0] = a.back();
+      a.pop_back();
+      sift_down(0);
+    } else {
+      a.pop_back();
+    }
+
+    return v;
+  }
+
+  /* v, which is in the queue, now goes earlier than it did */
+  void decrease_key(T v)
+  {
+    sift_up(*index(v));
+  }
+
+  /* Empties the queue, keeping its memory for reuse */
+  void clear()
+  {
+    for (uint32_t i = 0; i < a.size(); i++) {
+      set_pos(a[i], PQUEUE_NOT_QUEUED);
+    }
+    a.clear();
+  }
+
+ private:
+  static const uint32_t arity = 4;
+
+  std::vector<T> a;
+  Less less;
+  Index index;
+
+  void set_pos(T v, uint32_t i)
+  {
+    uint32_t *pos;
+
+    if ((pos = index(v))) {
+      *pos = i;
+    }
+  }
+
+  void sift_up(uint32_t i)
+  {
+    T v = a[i];
+    uint32_t p;
+
+    while (i && less(v, a[p = (i - 1) / arity])) {
+      a[i] = a[p];
+      set_pos(a[i], i);
+      i = p;
+    }
+    a[i] = v;
+    set_pos(v, i);
+  }
+
+  void sift_down(uint32_t i)
+  {
+    T v = a[i];
+    uint32_t c, min, end;
+
+    while ((c = i * arity + 1) < a.size()) {
+      end = c + arity < a.size() ? c + arity : a.size();
+      for (min = c++; c < end; c++) {
+        if (less(a[c], a[min])) {
+          min = c;
+        }
+      }
+      if (!less(a[min], v)) {
+        break;
+      }
+      a[i] = a[min];
+      set_pos(a[i], i);
+      i = min;
+    }
+    a[i] = v;
+    set_pos(v, i);
+  }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef TWHEEL_H
+# define TWHEEL_H
+
+# include <stdint.h>
+
+# include "pqueue.h"
+
+/* A timing wheel: a priority queue for elements keyed by a time that  *
+ * only moves forward in small steps, like next_turn.  Key returns an  *
+ * element's time; Link returns a pointer to a T in the element that   *
+ * the wheel uses to chain elements in the same slot.                  *
+ *                                                                     *
+ * There's one slot per time step for the next TWHEEL_SLOTS steps,     *
+ * each a FIFO list, and a bitmap of which slots are in use, so while  *
+ * every step is shorter than that, push and pop are O(1) and elements *
+ * with equal times come out in the order they went in.  Anything      *
+ * further out, or already in the past, waits in a heap and is moved   *
+ * onto the wheel once the wheel catches up to it.                     */
+
+# define TWHEEL_SLOTS 64
+
+template <class T, class Key, class Link>
+class twheel {
+ public:
+  twheel() : now(0), bits(0) {}
+
+  bool empty() const { return !bits && far.empty(); }
+
+  /* The key of the last element popped.  restart() sets it, which is *
+   * only allowed while the queue is empty; pushing the elements back *
+   * in the order they were popped then rebuilds an equivalent queue. */
+  int32_t time() const { return now; }
+  void restart(int32_t t) { now = t; }
+
+  /* The earliest element.  The queue must not be empty. */
+  T top()
+  {
+    int32_t t;
+
+    if (bits) {
+      t = next_time();
+      if (far.empty() || key(far.top()) >= t) {
+        return head[slot(t)];
+      }
+    }
+
+    return far.top();
+  }
+
+  void push(T v)
+  {
+    int32_t t = key(v);
+
+    if (t >= now && t - now < TWHEEL_SLOTS) {
+      append(v, slot(t));
+    } else {
+      far.push(v);
+    }
+  }
+
+  /* Removes and returns the earliest element.  The queue must not be *
+   * empty.                                                           */
+  T pop()
+  {
+    T v;
+    int32_t t;
+    uint32_t s;
+
+    if (bits) {
+      t = next_time();
+      if (far.empty() || key(far.top()) >= t) {
+        s = slot(t);
+        v = head[s];
+        if (!(head[s] = *link(v))) {
+          bits &= ~(1ULL << s);
+        }
+        now = t;
+        catch_up();
+
+        return v;
+      }
+    }
+
+    v = far.pop();
+    if (!bits) {
+      now = key(v);
+    }
+    catch_up();
+
+    return v;
+  }
+
+ private:
+  struct key_order {
+    Key key;
+    bool operator()(T a, T b) const { return key(a) < key(b); }
+  };
+
+  int32_t now;
+  uint64_t bits;
+  T head[TWHEEL_SLOTS];
+  T tail[TWHEEL_SLOTS];
+  pqueue<T, key_order> far;
+  Key key;
+  Link link;
+
+  static uint32_t slot(int32_t t) { return (uint32_t) t % TWHEEL_SLOTS; }
+
+  void append(T v, uint32_t s)
+  {
+    *link(v) = 0;
+    if (bits & (1ULL << s)) {
+      *link(tail[s]) = v;
+    } else {
+      head[s] = v;
+      bits |= 1ULL << s;
+    }
+    tail[s] = v;
+  }
+
+  /* Time of the first slot in use at or after now.  Bits must not be 0. */
+  int32_t next_time() const
+  {
+    uint32_t s = slot(now);
+    uint64_t b = s ? (bits >> s) | (bits << (TWHEEL_SLOTS - s)) : bits;
+
+    return now + __builtin_ctzll(b);
+  }
+
+  /* Moves the heap elements that now fall within the wheel onto it */
+  void catch_up()
+  {
+    int32_t t;
+
+    while (!far.empty() &&
+           (t = key(far.top())) >= now && t - now < TWHEEL_SLOTS) {
+      append(far.pop(), slot(t));
+    }
+  }
+};
+
+#endif